@@ -34,8 +34,8 @@ Settings::Settings() {
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 Settings::~Settings() {
-    myInternalSettings.clear();
-    myExternalSettings.clear();
+    mySettings.clear();
+    myIndex.clear();
 }
 
 void Settings::loadConfig(const char* config_file) {
@@ -231,11 +231,42 @@ void Settings::usage() {
             "     Ends each episode after this number of frames. 0 means never.\n"
             "   -color_averaging [true|false] (default: false)\n"
             "     Phosphor blends screens to reduce flicker\n"
+            "   -max_pool_last_two [true|false] (default: false)\n"
+            "     Max-pools the last two frames of each action to reduce flicker\n"
+            "   -max_pool_rgb [true|false] (default: false)\n"
+            "     Max-pools RGB values instead of grayscale ones\n"
             "   -record_screen_dir [save_directory]\n"
             "     Saves game screen images to save_directory\n"
             "   -repeat_action_probability (default: 0.25)\n"
             "     Stochasticity in the environment. It is the probability the previous "
             "action will repeated without executing the new one.\n"
+            "   -epoch_processing [true|false] (default: false)\n"
+            "     Visits every trajectory once per epoch, in shuffled order\n"
+            "   -epoch_window n (default: 16)\n"
+            "     Number of trajectories adjacent on disk shuffled together\n"
+            "   -start_frame_min n (default: 0)\n"
+            "   -start_frame_max n (default: 0)\n"
+            "     Episodes start at a frame drawn uniformly from [min, max]. Negative\n"
+            "     values count from the end of the episode\n"
+            "   -episode_cache_size n (default: 8)\n"
+            "     Number of episodes kept in memory for restoring states\n"
+            "   -screen_resolution HxW (default: none)\n"
+            "     Read the grayscale screens stored at this resolution by agcd-to-hdf5 -r\n"
+            "     instead of the full-size ones. Disables color averaging\n"
+            "   -crop_top n (default: 0)\n"
+            "   -crop_left n (default: 0)\n"
+            "   -crop_height n (default: 0)\n"
+            "   -crop_width n (default: 0)\n"
+            "     Only read this rectangle of the screens. A height or width of 0\n"
+            "     extends it to the bottom or right edge\n"
+            "   -raw_chunk_reads [true|false] (default: false)\n"
+            "     Read chunks of screens with batched asynchronous reads (io_uring, or\n"
+            "     pread where unavailable) and inflate them on worker threads,\n"
+            "     bypassing HDF5\n"
+            "   -inflate_threads n (default: 0)\n"
+            "     Number of threads inflating chunks read raw. 0 uses one per core\n"
+            "   -chunk_read_ahead n (default: 1)\n"
+            "     Number of chunks of screens read at once\n"
             "\n"
             " FIFO Controller arguments:\n"
             "   -run_length_encoding [true|false] (default: true)\n"
@@ -264,9 +295,9 @@ void Settings::saveConfig()
     // Do a quick scan of the internal settings to see if any have
     // changed.  If not, we don't need to save them at all.
     bool settingsChanged = false;
-    for(unsigned int i = 0; i < myInternalSettings.size(); ++i)
+    for(unsigned int i = 0; i < mySettings.size(); ++i)
     {
-        if(myInternalSettings[i].value != myInternalSettings[i].initialValue)
+        if(mySettings[i].internal && mySettings[i].value != mySettings[i].initialValue)
         {
             settingsChanged = true;
             break;
@@ -299,10 +330,11 @@ void Settings::saveConfig()
         << ";" << endl;
 
     // Write out each of the key and value pairs
-    for(unsigned int i = 0; i < myInternalSettings.size(); ++i)
+    for(unsigned int i = 0; i < mySettings.size(); ++i)
     {
-        out << myInternalSettings[i].key << " = " <<
-            myInternalSettings[i].value << endl;
+        if(mySettings[i].internal)
+            out << mySettings[i].key << " = " <<
+                mySettings[i].value << endl;
     }
 
     out.close();
@@ -379,19 +411,15 @@ void Settings::getSize(const string& key, int& x, int& y) const
 int Settings::getInt(const string& key, bool strict) const {
     // Try to find the named setting and answer its value
     int idx = -1;
-    if((idx = getInternalPos(key)) != -1) {
-        return (int) atoi(myInternalSettings[idx].value.c_str());
+    if((idx = getPos(key)) != -1) {
+        return mySettings[idx].intValue;
     } else {
-        if((idx = getExternalPos(key)) != -1) {
-            return (int) atoi(myExternalSettings[idx].value.c_str());
+        if (strict) {
+            std::cerr << "No value found for key: " << key << ". ";
+            std::cerr << "Make sure all the settings files are loaded." << endl;
+            exit(-1);
         } else {
-            if (strict) {
-                std::cerr << "No value found for key: " << key << ". ";
-                std::cerr << "Make sure all the settings files are loaded." << endl;
-                exit(-1);
-            } else {
-                return -1;
-            }
+            return -1;
         }
     }
 }
@@ -400,19 +428,15 @@ int Settings::getInt(const string& key, bool strict) const {
 float Settings::getFloat(const string& key, bool strict) const {
     // Try to find the named setting and answer its value
     int idx = -1;
-    if((idx = getInternalPos(key)) != -1) {
-        return (float) atof(myInternalSettings[idx].value.c_str());
+    if((idx = getPos(key)) != -1) {
+        return mySettings[idx].floatValue;
     } else {
-        if((idx = getExternalPos(key)) != -1) {
-            return (float) atof(myExternalSettings[idx].value.c_str());
+        if (strict) {
+            std::cerr << "No value found for key: " << key << ". ";
+            std::cerr << "Make sure all the settings files are loaded." << endl;
+            exit(-1);
         } else {
-            if (strict) {
-                std::cerr << "No value found for key: " << key << ". ";
-                std::cerr << "Make sure all the settings files are loaded." << endl;
-                exit(-1);
-            } else {
-                return -1.0;
-            }
+            return -1.0;
         }
     }
 }
@@ -421,23 +445,8 @@ float Settings::getFloat(const string& key, bool strict) const {
 bool Settings::getBool(const string& key, bool strict) const {
     // Try to find the named setting and answer its value
     int idx = -1;
-    if((idx = getInternalPos(key)) != -1)
-    {
-        const string& value = myInternalSettings[idx].value;
-        if(value == "1" || value == "true" || value == "True")
-            return true;
-        else if(value == "0" || value == "false" || value == "False")
-            return false;
-        else
-            return false;
-    } else if((idx = getExternalPos(key)) != -1) {
-        const string& value = myExternalSettings[idx].value;
-        if(value == "1" || value == "true")
-            return true;
-        else if(value == "0" || value == "false")
-            return false;
-        else
-            return false;
+    if((idx = getPos(key)) != -1) {
+        return mySettings[idx].boolValue;
     } else {
         if (strict) {
             std::cerr << "No value found for key: " << key << ". ";
@@ -453,10 +462,8 @@ bool Settings::getBool(const string& key, bool strict) const {
 const string& Settings::getString(const string& key, bool strict) const {
     // Try to find the named setting and answer its value
     int idx = -1;
-    if((idx = getInternalPos(key)) != -1) {
-        return myInternalSettings[idx].value;
-    } else if ((idx = getExternalPos(key)) != -1) {
-        return myExternalSettings[idx].value;
+    if((idx = getPos(key)) != -1) {
+        return mySettings[idx].value;
     } else {
         if (strict) {
             std::cerr << "No value found for key: " << key << ". ";
@@ -469,6 +476,15 @@ const string& Settings::getString(const string& key, bool strict) const {
     }
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Settings::Handle Settings::getHandle(const string& key) const {
+    Handle handle;
+    if((handle.index = getPos(key)) == -1) {
+        throw std::runtime_error("The key " + key + " you are trying to get does not exist.\n");
+    }
+    return handle;
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void Settings::setSize(const string& key, const int value1, const int value2)
 {
@@ -478,76 +494,56 @@ void Settings::setSize(const string& key, const int value1, const int value2)
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-int Settings::getInternalPos(const string& key) const
+int Settings::getPos(const string& key) const
 {
-    for(unsigned int i = 0; i < myInternalSettings.size(); ++i)
-        if(myInternalSettings[i].key == key)
-            return i;
+    unordered_map<string, int>::const_iterator it = myIndex.find(key);
+    return it != myIndex.end() ? it->second : -1;
+}
 
-    return -1;
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+int Settings::getInternalPos(const string& key) const
+{
+    int idx = getPos(key);
+    return idx != -1 && mySettings[idx].internal ? idx : -1;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 int Settings::getExternalPos(const string& key) const
 {
-    for(unsigned int i = 0; i < myExternalSettings.size(); ++i)
-        if(myExternalSettings[i].key == key)
-            return i;
+    int idx = getPos(key);
+    return idx != -1 && !mySettings[idx].internal ? idx : -1;
+}
 
-    return -1;
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Settings::setValue(int idx, const string& value, bool internal, bool useAsInitial)
+{
+    Setting& setting = mySettings[idx];
+    setting.value = value;
+    if(useAsInitial) setting.initialValue = value;
+    setting.internal = internal;
+    setting.intValue = atoi(value.c_str());
+    setting.floatValue = (float) atof(value.c_str());
+    // Only internal settings, read from rc files, may be capitalized
+    setting.boolValue = value == "1" || value == "true" || (internal && value == "True");
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 int Settings::setInternal(const string& key, const string& value,
                           int pos, bool useAsInitial)
 {
-    int idx = -1;
+    int idx = pos;
+    if(pos < 0 || pos >= (int)mySettings.size() || mySettings[pos].key != key)
+        idx = getPos(key);
 
-    if(pos != -1 && pos >= 0 && pos < (int)myInternalSettings.size() &&
-       myInternalSettings[pos].key == key)
-    {
-        idx = pos;
-    }
-    else
-    {
-        for(unsigned int i = 0; i < myInternalSettings.size(); ++i)
-        {
-            if(myInternalSettings[i].key == key)
-            {
-                idx = i;
-                break;
-            }
-        }
-    }
-
-    if(idx != -1)
-    {
-        myInternalSettings[idx].key   = key;
-        myInternalSettings[idx].value = value;
-        if(useAsInitial) myInternalSettings[idx].initialValue = value;
-
-        /*cerr << "modify internal: key = " << key
-             << ", value  = " << value
-             << ", ivalue = " << myInternalSettings[idx].initialValue
-             << " @ index = " << idx
-             << endl;*/
-    }
-    else
+    if(idx == -1)
     {
         Setting setting;
-        setting.key   = key;
-        setting.value = value;
-        if(useAsInitial) setting.initialValue = value;
-
-        myInternalSettings.push_back(setting);
-        idx = myInternalSettings.size() - 1;
-
-        /*cerr << "insert internal: key = " << key
-             << ", value  = " << value
-             << ", ivalue = " << setting.initialValue
-             << " @ index = " << idx
-             << endl;*/
+        setting.key = key;
+        mySettings.push_back(setting);
+        idx = mySettings.size() - 1;
+        myIndex[key] = idx;
     }
+    setValue(idx, value, true, useAsInitial);
 
     return idx;
 }
@@ -556,50 +552,23 @@ int Settings::setInternal(const string& key, const string& value,
 int Settings::setExternal(const string& key, const string& value,
                           int pos, bool useAsInitial)
 {
-    int idx = -1;
+    int idx = pos;
+    if(pos < 0 || pos >= (int)mySettings.size() || mySettings[pos].key != key)
+        idx = getPos(key);
 
-    if(pos != -1 && pos >= 0 && pos < (int)myExternalSettings.size() &&
-       myExternalSettings[pos].key == key)
+    if(idx == -1)
     {
-        idx = pos;
-    }
-    else
-    {
-        for(unsigned int i = 0; i < myExternalSettings.size(); ++i)
-        {
-            if(myExternalSettings[i].key == key)
-            {
-                idx = i;
-                break;
-            }
-        }
-    }
-
-    if(idx != -1)
-    {
-        myExternalSettings[idx].key   = key;
-        myExternalSettings[idx].value = value;
-        if(useAsInitial) myExternalSettings[idx].initialValue = value;
-
-        /*cerr << "modify external: key = " << key
-             << ", value = " << value
-             << " @ index = " << idx
-             << endl;*/
+        Setting setting;
+        setting.key = key;
+        mySettings.push_back(setting);
+        idx = mySettings.size() - 1;
+        myIndex[key] = idx;
+        setValue(idx, value, false, useAsInitial);
     }
     else
     {
-        Setting setting;
-        setting.key   = key;
-        setting.value = value;
-        if(useAsInitial) setting.initialValue = value;
-
-        myExternalSettings.push_back(setting);
-        idx = myExternalSettings.size() - 1;
-
-        /*cerr << "insert external: key = " << key
-             << ", value = " << value
-             << " @ index = " << idx
-             << endl;*/
+        // A key keeps the table it was first set in
+        setValue(idx, value, mySettings[idx].internal, useAsInitial);
     }
 
     return idx;
@@ -637,8 +606,27 @@ void Settings::setDefaultSettings() {
     boolSettings.insert(pair<string, bool>("color_averaging", false));
     boolSettings.insert(pair<string, bool>("send_rgb", false));
     intSettings.insert(pair<string, int>("frame_skip", 1));
+    boolSettings.insert(pair<string, bool>("max_pool_last_two", false));
+    boolSettings.insert(pair<string, bool>("max_pool_rgb", false));
     floatSettings.insert(pair<string, float>("repeat_action_probability", 0.25));
+    boolSettings.insert(pair<string, bool>("epoch_processing", false));
+    intSettings.insert(pair<string, int>("epoch_window", 16));
+    intSettings.insert(pair<string, int>("start_frame_min", 0));
+    intSettings.insert(pair<string, int>("start_frame_max", 0));
+    intSettings.insert(pair<string, int>("episode_cache_size", 8));
+    stringSettings.insert(pair<string, string>("episode_filter", ""));
+    stringSettings.insert(pair<string, string>("episode_order", ""));
+    intSettings.insert(pair<string, int>("crop_top", 0));
+    intSettings.insert(pair<string, int>("crop_left", 0));
+    intSettings.insert(pair<string, int>("crop_height", 0));
+    intSettings.insert(pair<string, int>("crop_width", 0));
     stringSettings.insert(pair<string, string>("rom_file", ""));
+    stringSettings.insert(pair<string, string>("screen_resolution", ""));
+    boolSettings.insert(pair<string, bool>("raw_chunk_reads", false));
+    intSettings.insert(pair<string, int>("inflate_threads", 0));
+    intSettings.insert(pair<string, int>("chunk_read_ahead", 1));
+    intSettings.insert(pair<string, int>("stream_workers", 2));
+    intSettings.insert(pair<string, int>("stream_buffer_size", 256));
 
     // Record settings
     intSettings.insert(pair<string, int>("fragsize", 64)); // fragsize to 64 ensures proper sound sync
@@ -667,7 +655,7 @@ void Settings::setDefaultSettings() {
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 template<typename ValueType>
-void Settings::verifyVariableExistence(map<string, ValueType> dict, string key){
+void Settings::verifyVariableExistence(const map<string, ValueType>& dict, const string& key){
     if(dict.find(key) == dict.end()){
         throw std::runtime_error("The key " + key + " you are trying to set does not exist.\n");
     }
@@ -23,6 +23,7 @@
 #include <stdexcept>
 #include <vector>
 #include <string>
+#include <unordered_map>
 
 class OSystem {
     friend class Settings;
@@ -62,6 +63,18 @@ public:
     ~Settings();
 
 public:
+    /**
+      A setting looked up once, whose value can then be read without
+      looking its key up again. Valid as long as the Settings object is.
+    */
+    class Handle
+    {
+        friend class Settings;
+        int index;
+    public:
+        Handle() : index(-1) { }
+    };
+
     /**
       This method should be called to load the current settings from an rc file.
     */
@@ -131,6 +144,28 @@ public:
     */
     const std::string& getString(const std::string& key, bool strict = false) const;
 
+    /**
+      Get the handle of the specified key.  Throws if the key does not
+      exist.
+
+      @param key The key of the setting to lookup
+      @return The handle of the setting
+    */
+    Handle getHandle(const std::string& key) const;
+
+    /**
+      Get the value of the setting with the specified handle, as parsed
+      when it was set.
+    */
+    int getInt(Handle handle) const
+    { return mySettings[handle.index].intValue; }
+    float getFloat(Handle handle) const
+    { return mySettings[handle.index].floatValue; }
+    bool getBool(Handle handle) const
+    { return mySettings[handle.index].boolValue; }
+    const std::string& getString(Handle handle) const
+    { return mySettings[handle.index].value; }
+
     /**
       Get the x*y size assigned to the specified key.  If the key does
       not exist (or is invalid) then results are -1 for each item.
@@ -208,15 +243,16 @@ protected:
         std::string key;
         std::string value;
         std::string initialValue;
+        // Whether the setting is saved to the rc file
+        bool internal = false;
+        // The value, parsed when it is set
+        int intValue = 0;
+        float floatValue = 0;
+        bool boolValue = false;
     };
     typedef std::vector<Setting> SettingsArray;
 
-    const SettingsArray& getInternalSettings() const
-    { return myInternalSettings; }
-    const SettingsArray& getExternalSettings() const
-    { return myExternalSettings; }
-
-    /** Get position in specified array of 'key' */
+    /** Get position of 'key' if it's internal (or external) */
     int getInternalPos(const std::string& key) const;
     int getExternalPos(const std::string& key) const;
 
@@ -233,15 +269,21 @@ private:
     std::map<std::string,float> floatSettings;
     std::map<std::string,std::string> stringSettings;
     template<typename ValueType>
-    void verifyVariableExistence(std::map<std::string, ValueType> dict, std::string key);
+    void verifyVariableExistence(const std::map<std::string, ValueType>& dict, const std::string& key);
+
+    /** Get position of 'key', internal or not, or -1 */
+    int getPos(const std::string& key) const;
+
+    /** Sets the value of the setting at 'idx', and parses it */
+    void setValue(int idx, const std::string& value, bool internal, bool useAsInitial);
 
-    // Holds key,value pairs that are necessary for Stella to
-    // function and must be saved on each program exit.
-    SettingsArray myInternalSettings;
+    // Holds all key,value pairs in one flat table, indexed by handles.
+    // Internal ones are necessary for Stella to function and must be saved
+    // on each program exit; external ones shouldn't be.
+    SettingsArray mySettings;
 
-    // Holds auxiliary key,value pairs that shouldn't be saved on
-    // program exit.
-    SettingsArray myExternalSettings;
+    // Position of each key in mySettings
+    std::unordered_map<std::string, int> myIndex;
 };
 
 #endif
@@ -15,7 +15,7 @@
 #include  <random>
 #include  <iterator>
 
-#include "hdf5_wrapper.hpp"
+#include "trajectory_store.hpp"
 #include "ale_interface.hpp"
 #include "agcd_interface.hpp"
 
@@ -32,8 +32,9 @@ Iter select_randomly(Iter start, Iter end, RandomGenerator& g) {
 
 template<typename Iter>
 Iter select_randomly(Iter start, Iter end) {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
+    // Per thread, as environments may run on several
+    static thread_local std::random_device rd;
+    static thread_local std::mt19937 gen(rd());
     return select_randomly(start, end, gen);
 }
 
@@ -60,11 +61,13 @@ static inline int episode_number(const std::string &path) {
 }
 
 AtariState::AtariState(const std::string &path, const std::string &game, bool
-        average, H5Wrapper &h5Wrapper, PhosphorBlend &phosphor, int episodeIndex) :
-        base_path(abspath(path)), current_frame(0),
-        h5Wrapper(h5Wrapper), aleScreen(210, 160), phosphor(phosphor) {
+        average, EpisodeCache &episodeCache, PhosphorBlend &phosphor, int episodeIndex) :
+        base_path(abspath(path)), current_frame(0), average(average),
+        episodeCache(episodeCache), aleScreen(
+            episodeCache.getStore().get_screen_height(),
+            episodeCache.getStore().get_screen_width()), phosphor(phosphor) {
 
-    game_vector_pair_t trajectories = h5Wrapper.get_trajectories(game);
+    const game_vector_pair_t &trajectories = episodeCache.getTrajectories();
     auto trajectoryId = *select_randomly(trajectories.begin(), trajectories.end());
 
     if (episodeIndex >= 0) {
@@ -76,22 +79,25 @@ AtariState::AtariState(const std::string &path, const std::string &game, bool
         trajectoryId = trajectories[episodeIndex];
     }
 
-    std::cout << "Reading episode " << trajectoryId.first
-              << " with " << trajectoryId.second << " frames..." << std::endl;
+    load(game, trajectoryId);
+}
 
-    trajectory = h5Wrapper.get_trajectory(game, trajectoryId.first);
+AtariState::AtariState(const std::string &path, const std::string &game, bool
+        average, EpisodeCache &episodeCache, PhosphorBlend &phosphor, const
+        game_pair_t &trajectoryId) :
+        base_path(abspath(path)), current_frame(0), average(average),
+        episodeCache(episodeCache), aleScreen(
+            episodeCache.getStore().get_screen_height(),
+            episodeCache.getStore().get_screen_width()), phosphor(phosphor) {
+    load(game, trajectoryId);
+}
 
-    if (average) {
-        std::cout << "Performing color averaging...";
-        screen_t previous = trajectory.first[0];
-        for (size_t j = 1; j < trajectory.first.size(); j++) {
-            screen_t tmp = trajectory.first[j];
-            phosphor.process(trajectory.first[j], previous, tmp);
-            previous = tmp;
-        }
-    }
+void AtariState::load(const std::string &game, const game_pair_t &trajectoryId) {
+    // Screens are read lazily, and color averaged, as the episode is played
+    episode = episodeCache.get(trajectoryId.first);
 
-    std::cout << " done! " << std::endl;
+    std::cout << "Reading episode " << trajectoryId.first
+              << " with " << episode->size() << " frames..." << std::endl;
 }
 
 inline static char *get_line(char *str, size_t strsize, FILE *fp) {
@@ -116,32 +122,52 @@ size_t AtariState::getCurrentFrame() {
 }
 
 Action AtariState::getCurrentAction() {
-    return static_cast<Action>(trajectory.second[current_frame].action);
+    return static_cast<Action>(episode->getAction(current_frame));
 }
 
 Action AtariState::getNextAction() {
-    if (current_frame < trajectory.first.size() - 2) {
-        return static_cast<Action>(trajectory.second[current_frame + 1].action);
+    if (current_frame < episode->size() - 2) {
+        return static_cast<Action>(episode->getAction(current_frame + 1));
     } else {
         return PLAYER_A_NOOP;
     }
 }
 
 reward_t AtariState::getNextReward() {
-    return trajectory.second[current_frame].reward;
+    return episode->getReward(current_frame);
 }
 
 bool AtariState::isTerminal() {
-    return current_frame == trajectory.first.size() - 1;
+    return current_frame == episode->size() - 1;
 }
 
 ALEScreen &AtariState::getScreen() {
-    aleScreen.m_pixels = trajectory.first[current_frame];
+    const pixel_t *current = episode->getScreen(current_frame);
+    if (average && current_frame > 0) {
+        aleScreen.setView(NULL);
+        phosphor.process(aleScreen, episode->getScreen(current_frame - 1), current);
+    } else if (episode->isMapped()) {
+        // Serve the frame straight from the mapped file
+        aleScreen.setView(current);
+    } else {
+        aleScreen.setView(NULL);
+        aleScreen.m_pixels.assign(current, current + episode->getScreenSize());
+    }
     return aleScreen;
 }
 
 void AtariState::step() {
-    if (current_frame < trajectory.first.size() - 1) {
+    if (current_frame < episode->size() - 1) {
         current_frame += 1;
     }
 }
+
+reward_t AtariState::skip(size_t frames) {
+    reward_t reward = episode->getRewardSum(current_frame, frames);
+    seek(current_frame + frames);
+    return reward;
+}
+
+void AtariState::seek(size_t frame) {
+    current_frame = std::min(frame, episode->size() - 1);
+}
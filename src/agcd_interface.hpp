@@ -6,6 +6,7 @@
 #define ALE_ATARI_GRAND_CHALLENGE_ATARI_GRAND_CHALLENGE_INTERFACE_HPP
 
 #include <vector>
+#include <memory>
 #include <algorithm>
 
 #include <dirent.h>
@@ -14,7 +15,8 @@
 #include <sys/stat.h>
 
 #include "phosphor_blend.hpp"
-#include "hdf5_wrapper.hpp"
+#include "trajectory_store.hpp"
+#include "episode.hpp"
 #include "ale_screen.hpp"
 #include "Constants.h"
 
@@ -28,16 +30,20 @@ private:
     std::string base_path;
     char base_name[MAX_BASE_LENGTH];
     char screen_path_template[MAX_PATH_LENGTH];
-    trajectory_t trajectory;
+    std::shared_ptr<Episode> episode;
     size_t current_frame;
-    std::vector<pixel_t> previousScreen;
+    bool average;
     bool loadedLast = false;
-    H5Wrapper &h5Wrapper;
+    EpisodeCache &episodeCache;
     ALEScreen aleScreen;
     PhosphorBlend &phosphor;
 
+    void load(const std::string &game, const game_pair_t &trajectoryId);
+
 public:
-    AtariState(const std::string &path, const std::string &game, bool average, H5Wrapper &h5Wrapper, PhosphorBlend &phosphor, int episodeIndex=-1);
+    AtariState(const std::string &path, const std::string &game, bool average, EpisodeCache &episodeCache, PhosphorBlend &phosphor, int episodeIndex=-1);
+    // Loads the given trajectory, as returned by TrajectoryStore::get_trajectories
+    AtariState(const std::string &path, const std::string &game, bool average, EpisodeCache &episodeCache, PhosphorBlend &phosphor, const game_pair_t &trajectoryId);
     ~AtariState() {
     }
 
@@ -48,14 +54,40 @@ public:
     bool isTerminal();
     ALEScreen &getScreen();
     void step();
+    // Steps `frames` times, returning the sum of the rewards of the frames
+    // stepped from
+    reward_t skip(size_t frames);
+    // Moves to the given frame of the episode. Only the chunk holding it (and
+    // its predecessor, when colour averaging) will be read.
+    void seek(size_t frame);
+    // Number of frames in the episode
+    size_t size() {
+        return episode->size();
+    }
+    const std::shared_ptr<Episode> &getEpisode() {
+        return episode;
+    }
+    // Replays another episode from the given frame
+    void setEpisode(const std::shared_ptr<Episode> &episode, size_t frame, bool loadedLast) {
+        this->episode = episode;
+        this->loadedLast = loadedLast;
+        seek(frame);
+    }
+    bool isAveraging() {
+        return average;
+    }
+    void setAveraging(bool average) {
+        this->average = average;
+    }
     bool hasLoadedLastEpisode() {
         return loadedLast;
     }
+    // Screen dimensions, after cropping
     int height() {
-        return 210;
+        return aleScreen.height();
     }
     int width() {
-        return 160;
+        return aleScreen.width();
     }
 };
 
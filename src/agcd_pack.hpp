@@ -0,0 +1,357 @@
+#ifndef ALE_ATARI_GRAND_CHALLENGE_AGCD_PACK_HPP
+#define ALE_ATARI_GRAND_CHALLENGE_AGCD_PACK_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trajectory_store.hpp"
+
+/*
+ * AGCD pack files are a flat alternative to the HDF5 files, laid out to be
+ * memory-mapped. All integers are in the native byte order of the machine
+ * that wrote the file, and are read in place without conversion, so files
+ * only move between machines of the same byte order. The version field
+ * tells the two apart, and files of the other byte order are rejected on
+ * open.
+ *
+ *   header          agcd_pack_header_t
+ *   events          per trajectory: reward (int32), score (int32), action
+ *                   (int8) and terminal (uint8) columns, one after the other
+ *   screens         per trajectory, page aligned: {frames, height, width}
+ *                   palette indices, either raw or run-length encoded
+ *   trajectories    per game, an array of agcd_pack_trajectory_t
+ *   games           an array of agcd_pack_game_t
+ *
+ * Run-length encoded screens start with frames + 1 uint64 offsets, relative to
+ * the start of the screens, of the data of each frame. The data of a frame is
+ * a sequence of (run length, palette index) byte pairs.
+ */
+
+static const char AGCD_PACK_MAGIC[8] = {'A', 'G', 'C', 'D', 'P', 'A', 'C', 'K'};
+static const uint32_t AGCD_PACK_VERSION = 1;
+
+enum agcd_pack_compression_t {
+    AGCD_PACK_RAW = 0,
+    AGCD_PACK_RLE = 1
+};
+
+struct agcd_pack_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_games;
+    uint64_t games_offset;
+};
+
+struct agcd_pack_game_t {
+    char name[32];
+    uint32_t num_trajectories;
+    uint32_t padding;
+    uint64_t trajectories_offset;
+};
+
+struct agcd_pack_trajectory_t {
+    char id[16];
+    uint32_t frames;
+    uint16_t height;
+    uint16_t width;
+    uint32_t compression;
+    uint32_t padding;
+    uint64_t events_offset;
+    uint64_t screens_offset;
+    uint64_t screens_size;
+};
+
+/* Run-length encodes a screen, appending it to `out` */
+static inline void agcd_pack_rle_encode(const pixel_t *screen, size_t size, std::vector<uint8_t> &out) {
+    for (size_t i = 0; i < size; ) {
+        size_t run = 1;
+        while (i + run < size && run < 255 && screen[i + run] == screen[i]) {
+            run++;
+        }
+        out.push_back((uint8_t) run);
+        out.push_back(screen[i]);
+        i += run;
+    }
+}
+
+static inline void agcd_pack_rle_decode(const uint8_t *data, size_t data_size, pixel_t *screen, size_t size) {
+    size_t offset = 0;
+    for (size_t i = 0; i + 1 < data_size && offset < size; i += 2) {
+        size_t run = std::min((size_t) data[i], size - offset);
+        memset(screen + offset, data[i + 1], run);
+        offset += run;
+    }
+}
+
+/*
+ * Reads AGCD pack files. The whole file is mapped, so frames are paged in
+ * straight from the page cache: raw screens are only copied out, and run-length
+ * encoded ones cost a trivial decode.
+ */
+class AGCDPack : public TrajectoryStore {
+private:
+    AGCDPack();
+    AGCDPack(const AGCDPack &);
+    const uint8_t *data;
+    size_t data_size;
+    /* Trajectories of each game, by id */
+    std::map<std::string, std::map<std::string, const agcd_pack_trajectory_t *>> trajectories;
+    std::vector<std::string> games;
+    bool native_resolution = true;
+
+    template <typename T>
+    const T *at(uint64_t offset, uint64_t count) const {
+        if (offset > data_size || count > (data_size - offset) / sizeof(T)) {
+            throw std::runtime_error("Corrupted AGCD pack file");
+        }
+        return reinterpret_cast<const T *>(data + offset);
+    }
+
+    const agcd_pack_trajectory_t *find(const std::string &game, const std::string &trajectory_id) const {
+        std::map<std::string, std::map<std::string, const agcd_pack_trajectory_t *>>::const_iterator it = trajectories.find(game);
+        if (it == trajectories.end()) {
+            return NULL;
+        }
+        std::map<std::string, const agcd_pack_trajectory_t *>::const_iterator jt = it->second.find(trajectory_id);
+        return jt == it->second.end() ? NULL : jt->second;
+    }
+
+    void map(int fd) {
+        struct stat st;
+        if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(agcd_pack_header_t)) {
+            throw std::invalid_argument("Not an AGCD pack file");
+        }
+        data_size = st.st_size;
+        void *map = mmap(NULL, data_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            throw std::runtime_error("Unable to map file");
+        }
+        data = (const uint8_t *) map;
+
+        const agcd_pack_header_t *header = at<agcd_pack_header_t>(0, 1);
+        if (memcmp(header->magic, AGCD_PACK_MAGIC, sizeof(AGCD_PACK_MAGIC)) != 0) {
+            munmap(map, data_size);
+            throw std::invalid_argument("Not an AGCD pack file");
+        }
+        if (header->version != AGCD_PACK_VERSION) {
+            const uint8_t *version = (const uint8_t *) &header->version;
+            uint32_t swapped = (uint32_t) version[0] << 24 | (uint32_t) version[1] << 16 |
+                               (uint32_t) version[2] << 8 | version[3];
+            munmap(map, data_size);
+            if (swapped == AGCD_PACK_VERSION) {
+                throw std::invalid_argument("AGCD pack file written on a machine of another byte order");
+            }
+            throw std::invalid_argument("Unsupported AGCD pack file version");
+        }
+
+        try {
+            const agcd_pack_game_t *game_table = at<agcd_pack_game_t>(header->games_offset, header->num_games);
+            for (size_t i = 0; i < header->num_games; i++) {
+                std::string name(game_table[i].name, strnlen(game_table[i].name, sizeof(game_table[i].name)));
+                const agcd_pack_trajectory_t *trajectory_table = at<agcd_pack_trajectory_t>(
+                    game_table[i].trajectories_offset, game_table[i].num_trajectories
+                );
+                games.push_back(name);
+                for (size_t j = 0; j < game_table[i].num_trajectories; j++) {
+                    const agcd_pack_trajectory_t *t = &trajectory_table[j];
+                    std::string id(t->id, strnlen(t->id, sizeof(t->id)));
+                    trajectories[name][id] = t;
+                }
+            }
+        } catch (...) {
+            munmap(map, data_size);
+            throw;
+        }
+    }
+
+public:
+    AGCDPack(const char *path) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            throw std::invalid_argument("Unable to open file");
+        }
+        try {
+            map(fd);
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+        close(fd);
+    }
+
+    /* Maps an open pack, e.g., a shared memory segment. The mapping outlives
+     * the descriptor, which the caller still owns. */
+    AGCDPack(int fd) {
+        map(fd);
+    }
+
+    ~AGCDPack() {
+        munmap((void *) data, data_size);
+    }
+
+    std::vector<std::string> get_games() {
+        std::vector<std::string> ret(games);
+        std::sort(ret.begin(), ret.end());
+        return ret;
+    }
+
+    game_vector_pair_t get_trajectories(std::string game) {
+        game_vector_pair_t ret;
+        std::map<std::string, std::map<std::string, const agcd_pack_trajectory_t *>>::iterator it = trajectories.find(game);
+        if (it == trajectories.end()) {
+            return ret;
+        }
+        for (std::map<std::string, const agcd_pack_trajectory_t *>::iterator jt = it->second.begin(); jt != it->second.end(); ++jt) {
+            ret.push_back(game_pair_t(jt->first, jt->second->frames));
+        }
+        std::sort(ret.begin(), ret.end(),
+            [](const game_pair_t &a, const game_pair_t &b) -> bool
+            {
+                return atoi(a.first.c_str()) < atoi(b.first.c_str());
+            }
+        );
+        return ret;
+    }
+
+    std::vector<haddr_t> get_trajectory_locations(std::string game) {
+        std::vector<haddr_t> ret;
+        game_vector_pair_t ids = get_trajectories(game);
+        for (size_t i = 0; i < ids.size(); i++) {
+            ret.push_back(find(game, ids[i].first)->screens_offset);
+        }
+        return ret;
+    }
+
+    agcd_events_t get_event_columns(std::string game, std::string trajectory_id, int columns,
+            hsize_t count = (hsize_t) -1) {
+        agcd_events_t events;
+        const agcd_pack_trajectory_t *t = find(game, trajectory_id);
+        if (t == NULL) {
+            printf("Something bad happened while reading %s.\n", trajectory_id.c_str());
+            return events;
+        }
+
+        size_t frames = t->frames;
+        events.length = std::min((size_t) count, frames);
+        const int32_t *reward = at<int32_t>(t->events_offset, frames);
+        const int32_t *score = at<int32_t>(t->events_offset + 4 * frames, frames);
+        const int8_t *action = at<int8_t>(t->events_offset + 8 * frames, frames);
+        const uint8_t *terminal = at<uint8_t>(t->events_offset + 9 * frames, frames);
+
+        if (columns & EVENT_FRAME) {
+            for (size_t i = 0; i < events.length; i++) {
+                events.frame.push_back(i);
+            }
+        }
+        if (columns & EVENT_REWARD) {
+            events.reward.assign(reward, reward + events.length);
+        }
+        if (columns & EVENT_SCORE) {
+            events.score.assign(score, score + events.length);
+        }
+        if (columns & EVENT_TERMINAL) {
+            events.terminal.assign(terminal, terminal + events.length);
+        }
+        if (columns & EVENT_ACTION) {
+            events.action.assign(action, action + events.length);
+        }
+
+        return events;
+    }
+
+    /* Every frame is stored on its own */
+    hsize_t get_chunk_frames(std::string game, std::string trajectory_id) {
+        return find(game, trajectory_id) ? 1 : 0;
+    }
+
+    std::vector<screen_t> get_screens(std::string game, std::string trajectory_id, hsize_t start, hsize_t count,
+            hsize_t stride = 1, hsize_t block = 1) {
+        std::vector<screen_t> screens;
+        const agcd_pack_trajectory_t *t = find(game, trajectory_id);
+        if (t == NULL || !native_resolution || t->height != HEIGHT || t->width != WIDTH) {
+            printf("Something bad happened while reading %s.\n", trajectory_id.c_str());
+            return screens;
+        }
+
+        if (stride == 1) {
+            count *= block;
+            block = 1;
+        } else if (block > stride) {
+            throw std::invalid_argument("Blocks of screens cannot overlap");
+        }
+
+        const size_t frame_size = HEIGHT * WIDTH;
+        const uint8_t *pixels = at<uint8_t>(t->screens_offset, t->screens_size);
+        const uint64_t *offsets = NULL;
+        if (t->compression == AGCD_PACK_RLE) {
+            offsets = at<uint64_t>(t->screens_offset, t->frames + 1);
+        } else if (t->screens_size < (uint64_t) t->frames * frame_size) {
+            throw std::runtime_error("Corrupted AGCD pack file");
+        }
+
+        std::vector<pixel_t> frame(frame_size);
+        for (size_t i = start; i + block <= t->frames && i < start + count * stride; i += stride) {
+            for (size_t j = i; j < i + block; j++) {
+                const pixel_t *p;
+                if (offsets != NULL) {
+                    if (offsets[j] > offsets[j + 1] || offsets[j + 1] > t->screens_size) {
+                        throw std::runtime_error("Corrupted AGCD pack file");
+                    }
+                    agcd_pack_rle_decode(pixels + offsets[j], offsets[j + 1] - offsets[j], &frame[0], frame_size);
+                    p = &frame[0];
+                } else {
+                    p = pixels + j * frame_size;
+                }
+
+                screen_t screen(crop_height * crop_width);
+                for (size_t row = 0; row < crop_height; row++) {
+                    const pixel_t *q = p + (crop_top + row) * WIDTH + crop_left;
+                    std::copy(q, q + crop_width, &screen[row * crop_width]);
+                }
+                screens.push_back(screen);
+            }
+        }
+
+        return screens;
+    }
+
+    const pixel_t *map_screens(std::string game, std::string trajectory_id, hsize_t &frames) {
+        const agcd_pack_trajectory_t *t = find(game, trajectory_id);
+        if (t == NULL || t->compression != AGCD_PACK_RAW || !native_resolution || is_cropped() ||
+                t->height != HEIGHT || t->width != WIDTH) {
+            return NULL;
+        }
+        frames = t->frames;
+        return at<pixel_t>(t->screens_offset, (uint64_t) t->frames * HEIGHT * WIDTH);
+    }
+
+    /* Pack files only hold full-size screens */
+    void set_resolution(hsize_t height, hsize_t width) {
+        native_resolution = height == 0 && width == 0;
+        screen_height = native_resolution ? HEIGHT : height;
+        screen_width = native_resolution ? WIDTH : width;
+        set_crop(0, 0, screen_height, screen_width);
+    }
+
+    bool is_grayscale() const {
+        return !native_resolution;
+    }
+
+    bool has_screens(std::string game) {
+        return native_resolution && trajectories.find(game) != trajectories.end();
+    }
+};
+
+#endif //ALE_ATARI_GRAND_CHALLENGE_AGCD_PACK_HPP
@@ -0,0 +1,362 @@
+#include <string>
+#include <vector>
+#include <cstring>
+#include <climits>
+#include <exception>
+
+#include "ale_c_wrapper.h"
+#include "ale_interface.hpp"
+#include "vector_ale_interface.hpp"
+
+static thread_local std::string last_error;
+static thread_local std::string last_string;
+
+/* Runs `f`, turning any exception into `failure` and the last error */
+template<typename F, typename R>
+static R guard(F f, R failure) {
+    try {
+        return f();
+    } catch (std::exception &e) {
+        last_error = e.what();
+    } catch (...) {
+        last_error = "Unknown error";
+    }
+    return failure;
+}
+
+template<typename F>
+static void guard(F f) {
+    try {
+        f();
+    } catch (std::exception &e) {
+        last_error = e.what();
+    } catch (...) {
+        last_error = "Unknown error";
+    }
+}
+
+/* Whether `ale` has a game loaded, setting the last error if it hasn't */
+static bool loaded(ALEInterface *ale) {
+    if (!ale->isLoaded()) {
+        last_error = "No game loaded";
+        return false;
+    }
+    return true;
+}
+
+static bool loaded(VectorALEInterface *envs) {
+    if (!envs->isLoaded()) {
+        last_error = "No game loaded";
+        return false;
+    }
+    return true;
+}
+
+const char *ALE_lastError(void) {
+    return last_error.c_str();
+}
+
+ALEInterface *ALE_new(void) {
+    return guard([]() { return new ALEInterface(); }, (ALEInterface *) NULL);
+}
+
+void ALE_del(ALEInterface *ale) {
+    delete ale;
+}
+
+const char *getString(ALEInterface *ale, const char *key) {
+    last_string = ale->getString(key);
+    return last_string.c_str();
+}
+
+int getInt(ALEInterface *ale, const char *key) {
+    return ale->getInt(key);
+}
+
+int getBool(ALEInterface *ale, const char *key) {
+    return ale->getBool(key);
+}
+
+float getFloat(ALEInterface *ale, const char *key) {
+    return ale->getFloat(key);
+}
+
+void setString(ALEInterface *ale, const char *key, const char *value) {
+    guard([&]() { ale->setString(key, value); });
+}
+
+void setInt(ALEInterface *ale, const char *key, int value) {
+    guard([&]() { ale->setInt(key, value); });
+}
+
+void setBool(ALEInterface *ale, const char *key, int value) {
+    guard([&]() { ale->setBool(key, value != 0); });
+}
+
+void setFloat(ALEInterface *ale, const char *key, float value) {
+    guard([&]() { ale->setFloat(key, value); });
+}
+
+int loadROM(ALEInterface *ale, const char *rom_file) {
+    return guard([&]() { ale->loadROM(rom_file); return 0; }, -1);
+}
+
+int act(ALEInterface *ale, int action) {
+    if (!loaded(ale)) {
+        return INT_MIN;
+    }
+    return guard([&]() { return (int) ale->act((Action) action); }, INT_MIN);
+}
+
+int game_over(ALEInterface *ale) {
+    return ale->game_over();
+}
+
+void reset_game(ALEInterface *ale) {
+    guard([&]() { ale->reset_game(); });
+}
+
+int reset_game_at(ALEInterface *ale, int episode, int frame) {
+    return guard([&]() { ale->reset_game_at(episode, frame); return 0; }, -1);
+}
+
+void getLegalActionSet(ALEInterface *ale, int *actions) {
+    ActionVect set = ale->getLegalActionSet();
+    for (size_t i = 0; i < set.size(); i++) {
+        actions[i] = set[i];
+    }
+}
+
+int getLegalActionSize(ALEInterface *ale) {
+    return ale->getLegalActionSet().size();
+}
+
+void getMinimalActionSet(ALEInterface *ale, int *actions) {
+    ActionVect set = ale->getMinimalActionSet();
+    for (size_t i = 0; i < set.size(); i++) {
+        actions[i] = set[i];
+    }
+}
+
+int getMinimalActionSize(ALEInterface *ale) {
+    return ale->getMinimalActionSet().size();
+}
+
+int getFrameNumber(ALEInterface *ale) {
+    return loaded(ale) ? ale->getFrameNumber() : -1;
+}
+
+int lives(ALEInterface *ale) {
+    return ale->lives();
+}
+
+int getEpisodeFrameNumber(ALEInterface *ale) {
+    return loaded(ale) ? ale->getEpisodeFrameNumber() : -1;
+}
+
+int getCurrentAction(ALEInterface *ale) {
+    return ale->getCurrentAction();
+}
+
+int getNextAction(ALEInterface *ale) {
+    return ale->getNextAction();
+}
+
+int getScreenWidth(ALEInterface *ale) {
+    if (!loaded(ale)) {
+        return -1;
+    }
+    return guard([&]() { return (int) ale->getScreen().width(); }, -1);
+}
+
+int getScreenHeight(ALEInterface *ale) {
+    if (!loaded(ale)) {
+        return -1;
+    }
+    return guard([&]() { return (int) ale->getScreen().height(); }, -1);
+}
+
+void getScreen(ALEInterface *ale, unsigned char *screen) {
+    if (!loaded(ale)) {
+        return;
+    }
+    guard([&]() {
+        const ALEScreen &current = ale->getScreen();
+        memcpy(screen, current.getArray(), current.arraySize());
+    });
+}
+
+void getScreenRGB(ALEInterface *ale, unsigned char *output_buffer) {
+    if (!loaded(ale)) {
+        return;
+    }
+    guard([&]() { ale->getScreenRGB(output_buffer); });
+}
+
+void getScreenGrayscale(ALEInterface *ale, unsigned char *output_buffer) {
+    if (!loaded(ale)) {
+        return;
+    }
+    guard([&]() { ale->getScreenGrayscale(output_buffer); });
+}
+
+const unsigned char *getScreenView(ALEInterface *ale) {
+    if (!loaded(ale)) {
+        return NULL;
+    }
+    return guard([&]() { return (const unsigned char *) ale->getScreen().getArray(); },
+        (const unsigned char *) NULL);
+}
+
+const unsigned char *getScreenGrayscaleView(ALEInterface *ale) {
+    if (!loaded(ale)) {
+        return NULL;
+    }
+    return guard([&]() { return ale->getScreenGrayscaleView(); }, (const unsigned char *) NULL);
+}
+
+const unsigned char *getPooledScreenView(ALEInterface *ale, size_t *size) {
+    *size = 0;
+    if (!loaded(ale)) {
+        return NULL;
+    }
+    const std::vector<unsigned char> &pooled = ale->getPooledScreen();
+    *size = pooled.size();
+    return pooled.empty() ? NULL : &pooled[0];
+}
+
+const double *getEpisodeReturns(ALEInterface *ale, double gamma, size_t *size) {
+    *size = 0;
+    if (!loaded(ale)) {
+        return NULL;
+    }
+    return guard([&]() {
+        const std::vector<double> &returns = ale->getEpisodeReturns(gamma);
+        *size = returns.size();
+        return returns.empty() ? NULL : &returns[0];
+    }, (const double *) NULL);
+}
+
+const double *getEpisodeNStepReturns(ALEInterface *ale, double gamma, int n, size_t *size) {
+    *size = 0;
+    if (!loaded(ale)) {
+        return NULL;
+    }
+    return guard([&]() {
+        const std::vector<double> &returns = ale->getEpisodeNStepReturns(gamma, n);
+        *size = returns.size();
+        return returns.empty() ? NULL : &returns[0];
+    }, (const double *) NULL);
+}
+
+void getRAM(ALEInterface *ale, unsigned char *ram) {
+    const ALERAM &current = ale->getRAM();
+    memcpy(ram, current.array(), current.size());
+}
+
+int getRAMSize(ALEInterface *ale) {
+    return ale->getRAM().size();
+}
+
+void saveState(ALEInterface *ale) {
+    ale->saveState();
+}
+
+void loadState(ALEInterface *ale) {
+    guard([&]() { ale->loadState(); });
+}
+
+ALEState *cloneState(ALEInterface *ale) {
+    return new ALEState(ale->cloneState());
+}
+
+void restoreState(ALEInterface *ale, ALEState *state) {
+    guard([&]() { ale->restoreState(*state); });
+}
+
+ALEState *cloneSystemState(ALEInterface *ale) {
+    return new ALEState(ale->cloneSystemState());
+}
+
+void restoreSystemState(ALEInterface *ale, ALEState *state) {
+    guard([&]() { ale->restoreSystemState(*state); });
+}
+
+void deleteState(ALEState *state) {
+    delete state;
+}
+
+void saveScreenPNG(ALEInterface *ale, const char *filename) {
+    ale->saveScreenPNG(filename);
+}
+
+VectorALEInterface *VectorALE_new(int num_envs) {
+    return guard([&]() { return new VectorALEInterface(num_envs > 0 ? num_envs : 0); },
+        (VectorALEInterface *) NULL);
+}
+
+void VectorALE_del(VectorALEInterface *envs) {
+    delete envs;
+}
+
+void VectorALE_setString(VectorALEInterface *envs, const char *key, const char *value) {
+    guard([&]() { envs->setString(key, value); });
+}
+
+void VectorALE_setInt(VectorALEInterface *envs, const char *key, int value) {
+    guard([&]() { envs->setInt(key, value); });
+}
+
+void VectorALE_setBool(VectorALEInterface *envs, const char *key, int value) {
+    guard([&]() { envs->setBool(key, value != 0); });
+}
+
+void VectorALE_setFloat(VectorALEInterface *envs, const char *key, float value) {
+    guard([&]() { envs->setFloat(key, value); });
+}
+
+int VectorALE_loadROM(VectorALEInterface *envs, const char *rom_file) {
+    return guard([&]() { envs->loadROM(rom_file); return 0; }, -1);
+}
+
+int VectorALE_size(VectorALEInterface *envs) {
+    return envs->size();
+}
+
+int VectorALE_getScreenWidth(VectorALEInterface *envs) {
+    if (!loaded(envs)) {
+        return -1;
+    }
+    return envs->getScreenWidth();
+}
+
+int VectorALE_getScreenHeight(VectorALEInterface *envs) {
+    if (!loaded(envs)) {
+        return -1;
+    }
+    return envs->getScreenHeight();
+}
+
+void VectorALE_reset(VectorALEInterface *envs, unsigned char *observations) {
+    if (!loaded(envs)) {
+        return;
+    }
+    guard([&]() { envs->reset(observations); });
+}
+
+void VectorALE_step(VectorALEInterface *envs, const int *actions, unsigned char *observations, int *rewards,
+        unsigned char *dones) {
+    if (!loaded(envs)) {
+        return;
+    }
+    guard([&]() {
+        envs->step(actions, observations, rewards, dones);
+    });
+}
+
+void VectorALE_getActions(VectorALEInterface *envs, int *actions) {
+    if (!loaded(envs)) {
+        return;
+    }
+    envs->getActions(actions);
+}
@@ -0,0 +1,133 @@
+#ifndef ALE_ATARI_GRAND_CHALLENGE_C_WRAPPER_H
+#define ALE_ATARI_GRAND_CHALLENGE_C_WRAPPER_H
+
+/*
+ * C interface to libale.so, for ctypes and other foreign function interfaces.
+ * Functions are named after those of the ALE's C wrapper, so that bindings
+ * written for it keep working.
+ *
+ * Buffers are either filled by the library, in which case the caller owns
+ * them and they must be large enough (getScreenHeight() * getScreenWidth()
+ * bytes per screen, or three times as many for RGB), or are returned by the
+ * library, in which case the library owns them and they are valid until the
+ * call stated next to the function. Either way, nothing is copied that
+ * doesn't have to be, so bindings can wrap frames without copying them again.
+ *
+ * Errors don't cross the interface: they are caught, and ALE_lastError()
+ * describes the last one of the calling thread. Functions that can tell the
+ * caller return -1 (or NULL) when they fail, including when they need a game
+ * and loadROM() hasn't loaded one; the others then do nothing.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+class ALEInterface;
+class ALEState;
+class VectorALEInterface;
+extern "C" {
+#else
+typedef struct ALEInterface ALEInterface;
+typedef struct ALEState ALEState;
+typedef struct VectorALEInterface VectorALEInterface;
+#endif
+
+/* Description of the last error of the calling thread */
+const char *ALE_lastError(void);
+
+ALEInterface *ALE_new(void);
+void ALE_del(ALEInterface *ale);
+
+/* The string is valid until the next getString() call of the thread */
+const char *getString(ALEInterface *ale, const char *key);
+int getInt(ALEInterface *ale, const char *key);
+int getBool(ALEInterface *ale, const char *key);
+float getFloat(ALEInterface *ale, const char *key);
+void setString(ALEInterface *ale, const char *key, const char *value);
+void setInt(ALEInterface *ale, const char *key, int value);
+void setBool(ALEInterface *ale, const char *key, int value);
+void setFloat(ALEInterface *ale, const char *key, float value);
+
+/* Returns 0, or -1 if the game can't be loaded */
+int loadROM(ALEInterface *ale, const char *rom_file);
+/* Returns the reward, or INT_MIN if it fails, as rewards can be negative */
+int act(ALEInterface *ale, int action);
+int game_over(ALEInterface *ale);
+void reset_game(ALEInterface *ale);
+/* Returns 0, or -1 if there's no such episode */
+int reset_game_at(ALEInterface *ale, int episode, int frame);
+
+void getLegalActionSet(ALEInterface *ale, int *actions);
+int getLegalActionSize(ALEInterface *ale);
+void getMinimalActionSet(ALEInterface *ale, int *actions);
+int getMinimalActionSize(ALEInterface *ale);
+
+int getFrameNumber(ALEInterface *ale);
+int lives(ALEInterface *ale);
+int getEpisodeFrameNumber(ALEInterface *ale);
+/* As getInt("current_action") and getInt("next_action"), without the key
+ * lookup */
+int getCurrentAction(ALEInterface *ale);
+int getNextAction(ALEInterface *ale);
+
+int getScreenWidth(ALEInterface *ale);
+int getScreenHeight(ALEInterface *ale);
+/* Fills `screen` with the current screen, as palette indices (or grayscale
+ * values, at a downscaled resolution) */
+void getScreen(ALEInterface *ale, unsigned char *screen);
+void getScreenRGB(ALEInterface *ale, unsigned char *output_buffer);
+void getScreenGrayscale(ALEInterface *ale, unsigned char *output_buffer);
+/* Returns the current screen, as getScreen() would fill it, in place. Valid
+ * until the screen is asked for again, or the interface is stepped, reset,
+ * reloaded, restored or deleted. */
+const unsigned char *getScreenView(ALEInterface *ale);
+/* Returns the current screen, as getScreenGrayscale() would fill it, in
+ * place. Valid for as long as getScreenView()'s. */
+const unsigned char *getScreenGrayscaleView(ALEInterface *ale);
+/* Returns the pooled screen (see max_pool_last_two), of `*size` bytes. Valid
+ * until the interface is stepped, reset, reloaded or deleted. */
+const unsigned char *getPooledScreenView(ALEInterface *ale, size_t *size);
+
+/* Return the returns of every frame of the current episode, of `*size`
+ * values. Valid until the interface moves to another episode or is
+ * deleted. */
+const double *getEpisodeReturns(ALEInterface *ale, double gamma, size_t *size);
+const double *getEpisodeNStepReturns(ALEInterface *ale, double gamma, int n, size_t *size);
+
+void getRAM(ALEInterface *ale, unsigned char *ram);
+int getRAMSize(ALEInterface *ale);
+
+void saveState(ALEInterface *ale);
+void loadState(ALEInterface *ale);
+/* States are owned by the caller, and freed with deleteState() */
+ALEState *cloneState(ALEInterface *ale);
+void restoreState(ALEInterface *ale, ALEState *state);
+ALEState *cloneSystemState(ALEInterface *ale);
+void restoreSystemState(ALEInterface *ale, ALEState *state);
+void deleteState(ALEState *state);
+
+void saveScreenPNG(ALEInterface *ale, const char *filename);
+
+/* See VectorALEInterface */
+VectorALEInterface *VectorALE_new(int num_envs);
+void VectorALE_del(VectorALEInterface *envs);
+void VectorALE_setString(VectorALEInterface *envs, const char *key, const char *value);
+void VectorALE_setInt(VectorALEInterface *envs, const char *key, int value);
+void VectorALE_setBool(VectorALEInterface *envs, const char *key, int value);
+void VectorALE_setFloat(VectorALEInterface *envs, const char *key, float value);
+/* Returns 0, or -1 if the game can't be loaded */
+int VectorALE_loadROM(VectorALEInterface *envs, const char *rom_file);
+int VectorALE_size(VectorALEInterface *envs);
+int VectorALE_getScreenWidth(VectorALEInterface *envs);
+int VectorALE_getScreenHeight(VectorALEInterface *envs);
+/* `observations` holds size() screens, one after the other */
+void VectorALE_reset(VectorALEInterface *envs, unsigned char *observations);
+void VectorALE_step(VectorALEInterface *envs, const int *actions, unsigned char *observations, int *rewards,
+        unsigned char *dones);
+void VectorALE_getActions(VectorALEInterface *envs, int *actions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ALE_ATARI_GRAND_CHALLENGE_C_WRAPPER_H */
@@ -1,7 +1,12 @@
 #include "ale_interface.hpp"
 
 #include <iostream>
+#include <sstream>
+#include <random>
 #include <utility>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
 
 const Action SPACE_INVADERS_MINIMAL[] = {
         PLAYER_A_NOOP, PLAYER_A_LEFT, PLAYER_A_RIGHT, PLAYER_A_FIRE,
@@ -34,7 +39,25 @@ const Action PINBALL_MINIMAL[] = {
         PLAYER_A_LEFTFIRE,
 };
 
-static void split_rom_game_path(const std::string &rom_file, std::string &h5file, std::string &game) {
+size_t episode_frame(int frame, size_t size) {
+    if (frame < 0) {
+        frame = std::max((int) size + frame, 0);
+    }
+    return std::min((size_t) frame, size - 1);
+}
+
+void split_rom_game_path(const std::string &rom_file, std::string &h5file, std::string &game) {
+    // Shared memory segments and servers are named by the first component
+    // after the prefix
+    const char *prefixes[] = {SHM_PREFIX, TCP_PREFIX};
+    for (size_t p = 0; p < sizeof(prefixes) / sizeof(prefixes[0]); p++) {
+        if (rom_file.compare(0, strlen(prefixes[p]), prefixes[p]) == 0) {
+            size_t i = rom_file.find(path_separator, strlen(prefixes[p]));
+            h5file = rom_file.substr(0, i);
+            game = i == std::string::npos ? "" : rom_file.substr(i + 1);
+            return;
+        }
+    }
     for (size_t i = 1; i < rom_file.size(); i++) {
         if (rom_file[i] == path_separator) {
             if (file_exists(rom_file.substr(0, i))) {
@@ -54,11 +77,60 @@ static void split_rom_game_path(const std::string &rom_file, std::string &h5file
     game = "";
 }
 
+std::shared_ptr<TrajectoryStore> open_game_store(const std::string &path, const std::string &game,
+        const Settings &settings) {
+    std::string resolution = settings.getString("screen_resolution");
+    bool raw_chunk_reads = settings.getBool("raw_chunk_reads");
+    int inflate_threads = std::max(settings.getInt("inflate_threads"), 0);
+    // A crop height or width of 0 extends to the bottom or right edge
+    int crop_top = settings.getInt("crop_top");
+    int crop_left = settings.getInt("crop_left");
+    int crop_height = settings.getInt("crop_height");
+    int crop_width = settings.getInt("crop_width");
+
+    // Environments that open the same file with the same settings share the
+    // store, and hence the episodes read from it
+    std::ostringstream key;
+    key << path << '|' << game << '|' << resolution << '|' << raw_chunk_reads << '|' << inflate_threads
+        << '|' << crop_top << ',' << crop_left << ',' << crop_height << ',' << crop_width;
+    return EpisodeRegistry::instance().getStore(key.str(), [&]() {
+        std::unique_ptr<TrajectoryStore> opened(open_trajectory_store(path.c_str()));
+        opened->set_raw_chunk_reads(raw_chunk_reads, inflate_threads);
+        if (!resolution.empty()) {
+            unsigned int height, width;
+            if (sscanf(resolution.c_str(), "%ux%u", &height, &width) != 2) {
+                throw std::invalid_argument("Invalid screen resolution " + resolution);
+            }
+            opened->set_resolution(height, width);
+            if (!opened->has_screens(game)) {
+                throw std::invalid_argument("No screens at resolution " + resolution + " for " + game);
+            }
+        }
+        opened->set_crop(
+            crop_top, crop_left,
+            crop_height > 0 ? crop_height : (int) opened->get_screen_height() - crop_top,
+            crop_width > 0 ? crop_width : (int) opened->get_screen_width() - crop_left
+        );
+        return opened.release();
+    });
+}
+
+// Element-wise maximum of two byte buffers. Simple enough for the compiler to
+// turn into packed byte max instructions.
+static inline void max_pool(unsigned char * __restrict dst, const unsigned char * __restrict src, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        dst[i] = std::max(dst[i], src[i]);
+    }
+}
+
 reward_t ALEInterface::act(Action action) {
-    reward_t reward = 0;
-    for (size_t i = 0; i < frame_skip; i++) {
-        reward += atariState->getNextReward();
-        atariState->step();
+    // The frame seen before the last step, for max-pooling
+    size_t previous_frame = std::min(atariState->getCurrentFrame() + frame_skip - 1, atariState->size() - 1);
+    size_t frame = atariState->getCurrentFrame();
+    reward_t reward = atariState->skip(frame_skip);
+    total_frames += atariState->getCurrentFrame() - frame;
+    if (max_pool_last_two) {
+        updatePooledScreen(previous_frame);
     }
     if (displayScreen) {
         displayScreen->display_screen();
@@ -73,14 +145,16 @@ ALEInterface::~ALEInterface() {
     if (displayScreen != NULL) {
         delete displayScreen;
     }
-    if (h5Wrapper != NULL) {
-        delete h5Wrapper;
+    if (episodeCache != NULL) {
+        delete episodeCache;
+    }
+    if (episodeSampler != NULL) {
+        delete episodeSampler;
     }
 }
 
 ALEInterface::ALEInterface() {
     theSettings.reset(new Settings);
-    setInt("frame_skip", 1);
 }
 
 ALEInterface::ALEInterface(bool display_screen) : display_screen(display_screen) {
@@ -95,20 +169,34 @@ std::string ALEInterface::getString(const std::string& key) {
 
 int ALEInterface::getInt(const std::string& key) {
     if (key == "current_action" && atariState != NULL) {
-        return atariState->getCurrentAction();
+        return getCurrentAction();
     }
     if (key == "next_action" && atariState != NULL) {
-        int ret = atariState->getNextAction();
-        if (minimalActionCache[ret]) {
-            return ret;
-        } else {
-            return PLAYER_A_NOOP;
-        }
+        return getNextAction();
+    }
+    if (key == "current_epoch" && episodeSampler != NULL) {
+        return getEpoch();
     }
     assert(theSettings.get());
     return theSettings->getInt(key);
 }
 
+Action ALEInterface::getCurrentAction() const {
+    return atariState != NULL ? atariState->getCurrentAction() : PLAYER_A_NOOP;
+}
+
+Action ALEInterface::getNextAction() const {
+    if (atariState == NULL) {
+        return PLAYER_A_NOOP;
+    }
+    Action ret = atariState->getNextAction();
+    return minimalActionCache[ret] ? ret : PLAYER_A_NOOP;
+}
+
+int ALEInterface::getEpoch() const {
+    return episodeSampler != NULL ? episodeSampler->getEpoch() : 0;
+}
+
 bool ALEInterface::getBool(const std::string& key) {
     if (key == "loadedLast") {
         if (atariState != NULL) {
@@ -129,13 +217,11 @@ float ALEInterface::getFloat(const std::string& key) {
 void ALEInterface::setString(const std::string& key, const std::string& value) {
     assert(theSettings.get());
     theSettings->setString(key, value);
-    theSettings->validate();
 }
 
 void ALEInterface::setInt(const std::string& key, const int value) {
     assert(theSettings.get());
     theSettings->setInt(key, value);
-    theSettings->validate();
 }
 
 void ALEInterface::setBool(const std::string& key, const bool value) {
@@ -145,13 +231,11 @@ void ALEInterface::setBool(const std::string& key, const bool value) {
     }
     assert(theSettings.get());
     theSettings->setBool(key, value);
-    theSettings->validate();
 }
 
 void ALEInterface::setFloat(const std::string& key, const float value) {
     assert(theSettings.get());
     theSettings->setFloat(key, value);
-    theSettings->validate();
 }
 
 /*
@@ -186,27 +270,69 @@ void ALEInterface::loadROM(std::string rom_file) {
     if (atariState != NULL) {
         delete atariState;
     }
-    if (h5Wrapper != NULL) {
-        delete h5Wrapper;
+    if (episodeCache != NULL) {
+        delete episodeCache;
+        episodeCache = NULL;
     }
+    savedStates = std::stack<ALEState>();
+    // Settings are only validated once they take effect, rather than on
+    // every set
+    theSettings->validate();
+    start_frame_min = theSettings->getHandle("start_frame_min");
+    start_frame_max = theSettings->getHandle("start_frame_max");
 
     split_rom_game_path(rom_file, romPath, gameName);
-    h5Wrapper = new H5Wrapper(romPath.c_str());
+    store = open_game_store(romPath, gameName, *theSettings);
+    // Downscaled screens are grayscale, so there's no palette to blend with
+    grayscale_screens = store->is_grayscale();
+    color_averaging = getBool("color_averaging") && !grayscale_screens;
+    episodeCache = new EpisodeCache(
+        store, gameName, getInt("episode_cache_size"),
+        std::max(getInt("max_num_frames_per_episode"), 0),
+        EpisodeQuery(getString("episode_filter"), getString("episode_order"))
+    );
+    max_num_frames = getInt("max_num_frames");
+    total_frames = 0;
+
+    unsigned int seed = getInt("random_seed");
+    if (seed == 0) {
+        seed = std::random_device()();
+    }
+    rng.seed(seed);
 
-    current_episode = 0;
-    if (sequential) {
-        atariState = new AtariState(romPath, gameName, getBool("color_averaging"), *h5Wrapper, phosphor, 0);
-    } else {
-        atariState = new AtariState(romPath, gameName, getBool("color_averaging"), *h5Wrapper, phosphor);
+    if (episodeSampler != NULL) {
+        delete episodeSampler;
+        episodeSampler = NULL;
+    }
+    if (getBool("epoch_processing")) {
+        episodeSampler = new EpisodeSampler(
+            episodeCache->getTrajectories(), episodeCache->getTrajectoryLocations(), getInt("epoch_window"), seed
+        );
     }
 
+    frame_skip = getInt("frame_skip");
+    if (frame_skip < 1) {
+        frame_skip = 1;
+    }
+
+    max_pool_last_two = getBool("max_pool_last_two");
+    max_pool_rgb = getBool("max_pool_rgb");
+    // Only read the frames act() will look at. Episodes are shared, so this
+    // has to be set before any is read.
+    episodeCache->setStride(frame_skip, color_averaging || max_pool_last_two);
+    episodeCache->setReadAhead(std::max(getInt("chunk_read_ahead"), 1));
+
+    current_episode = 0;
+    atariState = newAtariState();
+    seekStartFrame();
+
     memset(&minimalActionCache, 0, sizeof(minimalActionCache));
     minimalActions.clear();
     allActions.clear();
 
-    frame_skip = getInt("frame_skip");
-    if (frame_skip < 1) {
-        frame_skip = 1;
+    palette.setPalette("standard", "NTSC");
+    if (max_pool_last_two) {
+        updatePooledScreen(atariState->getCurrentFrame());
     }
 
     for (int i = 0 ; i < PLAYER_B_NOOP ; i++) {
@@ -246,14 +372,43 @@ void ALEInterface::loadROM(std::string rom_file) {
     setString("rom_file", rom_file);
 
     if (display_screen) {
-        palette.setPalette("standard", "NTSC");
         displayScreen = new DisplayScreen(atariState, palette);
     }
 }
 
+AtariState *ALEInterface::newAtariState() {
+    AtariState *ret;
+    if (episodeSampler != NULL) {
+        ret = new AtariState(romPath, gameName, color_averaging, *episodeCache, phosphor, episodeSampler->next());
+    } else if (sequential) {
+        ret = new AtariState(romPath, gameName, color_averaging, *episodeCache, phosphor, current_episode);
+    } else {
+        return new AtariState(romPath, gameName, color_averaging, *episodeCache, phosphor);
+    }
+    prefetchNextEpisode();
+    return ret;
+}
+
+void ALEInterface::prefetchNextEpisode() {
+    // Random picks can't be known in advance
+    if (episodeSampler != NULL) {
+        const game_pair_t *next = episodeSampler->peek();
+        if (next != NULL) {
+            episodeCache->prefetch(next->first);
+        }
+    } else if (sequential) {
+        const game_vector_pair_t &trajectories = episodeCache->getTrajectories();
+        if (current_episode + 1 < (int) trajectories.size()) {
+            episodeCache->prefetch(trajectories[current_episode + 1].first);
+        }
+    }
+}
+
 bool ALEInterface::game_over() const {
     if (atariState == NULL)
         return false;
+    if (max_num_frames > 0 && total_frames >= (size_t) max_num_frames)
+        return true;
     return atariState->isTerminal() || atariState->hasLoadedLastEpisode();
 }
 
@@ -266,10 +421,11 @@ void ALEInterface::reset_game() {
             }
             delete atariState;
         }
-        if (sequential) {
-            atariState = new AtariState(romPath, gameName, getBool("color_averaging"), *h5Wrapper, phosphor, ++current_episode);
-        } else {
-            atariState = new AtariState(romPath, gameName, getBool("color_averaging"), *h5Wrapper, phosphor);
+        ++current_episode;
+        atariState = newAtariState();
+        seekStartFrame();
+        if (max_pool_last_two) {
+            updatePooledScreen(atariState->getCurrentFrame());
         }
         if (displayScreen != NULL) {
             delete displayScreen;
@@ -278,6 +434,42 @@ void ALEInterface::reset_game() {
     }
 }
 
+void ALEInterface::reset_game_at(int episode, int frame) {
+    if (romPath.size() == 0) {
+        return;
+    }
+    const game_vector_pair_t &trajectories = episodeCache->getTrajectories();
+    if (episode < 0 || episode >= (int) trajectories.size()) {
+        throw std::out_of_range("Invalid episode index");
+    }
+    if (atariState != NULL) {
+        delete atariState;
+    }
+    current_episode = episode;
+    atariState = new AtariState(romPath, gameName, color_averaging, *episodeCache, phosphor, trajectories[episode]);
+    atariState->seek(episode_frame(frame, atariState->size()));
+    if (max_pool_last_two) {
+        updatePooledScreen(atariState->getCurrentFrame());
+    }
+    if (displayScreen != NULL) {
+        delete displayScreen;
+        displayScreen = new DisplayScreen(atariState, palette);
+    }
+}
+
+void ALEInterface::seekStartFrame() {
+    int first = theSettings->getInt(start_frame_min);
+    int last = theSettings->getInt(start_frame_max);
+    if (first == 0 && last == 0) {
+        return;
+    }
+    size_t size = atariState->size();
+    size_t a = episode_frame(first, size);
+    size_t b = episode_frame(last, size);
+    std::uniform_int_distribution<size_t> dis(std::min(a, b), std::max(a, b));
+    atariState->seek(dis(rng));
+}
+
 ActionVect ALEInterface::getLegalActionSet() {
     return allActions;
 }
@@ -298,12 +490,108 @@ const ALEScreen &ALEInterface::getScreen() {
     return atariState->getScreen();
 }
 
+void ALEInterface::decodeScreen(std::vector<unsigned char> &output_buffer, const pixel_t *screen, size_t size, bool rgb) {
+    output_buffer.resize(rgb ? size * 3 : size);
+    decodeScreen(&output_buffer[0], screen, size, rgb);
+}
+
+void ALEInterface::decodeScreen(unsigned char *output_buffer, const pixel_t *screen, size_t size, bool rgb) {
+    if (grayscale_screens) {
+        for (size_t i = 0; i < size; i++) {
+            if (rgb) {
+                output_buffer[3 * i] = output_buffer[3 * i + 1] = output_buffer[3 * i + 2] = screen[i];
+            } else {
+                output_buffer[i] = screen[i];
+            }
+        }
+    } else if (rgb) {
+        palette.applyPaletteRGB(output_buffer, const_cast<pixel_t *>(screen), size);
+    } else {
+        palette.applyPaletteGrayscale(output_buffer, const_cast<pixel_t *>(screen), size);
+    }
+}
+
 void ALEInterface::getScreenGrayscale(std::vector<unsigned char> &grayscale_output_buffer) {
+    if (max_pool_last_two && !max_pool_rgb) {
+        grayscale_output_buffer = pooledScreen;
+        return;
+    }
+    ALEScreen &screen = atariState->getScreen();
+    decodeScreen(grayscale_output_buffer, screen.getArray(), screen.arraySize(), false);
+}
+
+void ALEInterface::getScreenGrayscale(unsigned char *grayscale_output_buffer) {
+    if (max_pool_last_two && !max_pool_rgb) {
+        memcpy(grayscale_output_buffer, &pooledScreen[0], pooledScreen.size());
+        return;
+    }
+    ALEScreen &screen = atariState->getScreen();
+    decodeScreen(grayscale_output_buffer, screen.getArray(), screen.arraySize(), false);
+}
 
+const unsigned char *ALEInterface::getScreenGrayscaleView() {
+    if (max_pool_last_two && !max_pool_rgb) {
+        return &pooledScreen[0];
+    }
+    if (grayscale_screens && !atariState->isAveraging()) {
+        return atariState->getEpisode()->getScreen(atariState->getCurrentFrame());
+    }
+    ALEScreen &screen = atariState->getScreen();
+    if (grayscale_screens) {
+        return screen.getArray();
+    }
+    grayscaleScreen.resize(screen.arraySize());
+    decodeScreen(&grayscaleScreen[0], screen.getArray(), screen.arraySize(), false);
+    return &grayscaleScreen[0];
 }
 
 void ALEInterface::getScreenRGB(std::vector<unsigned char> &output_rgb_buffer) {
+    if (max_pool_last_two && max_pool_rgb) {
+        output_rgb_buffer = pooledScreen;
+        return;
+    }
+    ALEScreen &screen = atariState->getScreen();
+    decodeScreen(output_rgb_buffer, screen.getArray(), screen.arraySize(), true);
+}
+
+void ALEInterface::getScreenRGB(unsigned char *output_rgb_buffer) {
+    if (max_pool_last_two && max_pool_rgb) {
+        memcpy(output_rgb_buffer, &pooledScreen[0], pooledScreen.size());
+        return;
+    }
+    ALEScreen &screen = atariState->getScreen();
+    decodeScreen(output_rgb_buffer, screen.getArray(), screen.arraySize(), true);
+}
+
+const std::vector<double> &ALEInterface::getEpisodeReturns(double gamma) {
+    return atariState->getEpisode()->getReturns(gamma);
+}
+
+const std::vector<double> &ALEInterface::getEpisodeNStepReturns(double gamma, int n) {
+    if (n < 1) {
+        throw std::invalid_argument("n-step returns need at least one step");
+    }
+    return atariState->getEpisode()->getNStepReturns(gamma, n);
+}
+
+const std::vector<unsigned char> &ALEInterface::getPooledScreen() const {
+    return pooledScreen;
+}
+
+void ALEInterface::updatePooledScreen(size_t previous_frame) {
+    // Pooling happens over raw frames, as in the ALE, so colour averaging
+    // doesn't apply here
+    std::shared_ptr<Episode> episode = atariState->getEpisode();
+    size_t frame = atariState->getCurrentFrame();
+    const pixel_t *current = episode->getScreen(frame);
+
+    decodeScreen(pooledScreen, current, episode->getScreenSize(), max_pool_rgb);
 
+    if (previous_frame != frame) {
+        const pixel_t *previous = episode->getScreen(previous_frame);
+        decodeScreen(pooledScratch, previous, episode->getScreenSize(), max_pool_rgb);
+        max_pool(&pooledScreen[0], &pooledScratch[0], pooledScreen.size());
+    }
 }
 
 const ALERAM &ALEInterface::getRAM() {
@@ -311,27 +599,52 @@ const ALERAM &ALEInterface::getRAM() {
 }
 
 void ALEInterface::saveState() {
-
+    savedStates.push(cloneState());
 }
 
 void ALEInterface::loadState() {
-
+    if (savedStates.empty()) {
+        return;
+    }
+    restoreState(savedStates.top());
+    savedStates.pop();
 }
 
 ALEState ALEInterface::cloneState() {
-    return ALEState();
+    ALEState state;
+    if (atariState != NULL) {
+        state.trajectory = atariState->getEpisode()->getId();
+        state.episode = current_episode;
+        state.frame = atariState->getCurrentFrame();
+        state.average = atariState->isAveraging();
+        state.loadedLast = atariState->hasLoadedLastEpisode();
+    }
+    return state;
 }
 
 void ALEInterface::restoreState(const ALEState &state) {
-
+    if (atariState == NULL || state.trajectory.empty()) {
+        return;
+    }
+    if (state.trajectory == atariState->getEpisode()->getId()) {
+        atariState->seek(state.frame);
+    } else {
+        atariState->setEpisode(episodeCache->get(state.trajectory), state.frame, state.loadedLast);
+    }
+    atariState->setAveraging(state.average);
+    current_episode = state.episode;
+    if (max_pool_last_two) {
+        updatePooledScreen(atariState->getCurrentFrame());
+    }
 }
 
 ALEState ALEInterface::cloneSystemState() {
-    return ALEState();
+    // Replaying a trajectory involves no randomness
+    return cloneState();
 }
 
 void ALEInterface::restoreSystemState(const ALEState &state) {
-
+    restoreState(state);
 }
 
 void ALEInterface::saveScreenPNG(const std::string &filename) {
@@ -35,6 +35,8 @@
 
 #include <string>
 #include <vector>
+#include <stack>
+#include <random>
 
 #include "Constants.h"
 #include "ale_screen.hpp"
@@ -42,6 +44,7 @@
 #include "Settings.hpp"
 #include "display_screen.h"
 #include "agcd_interface.hpp"
+#include "episode_sampler.hpp"
 
 static const std::string Version = "0.5.1";
 
@@ -53,7 +56,43 @@ const char path_separator = '/';
 
 typedef int reward_t;
 
-class ALEState{};
+// Splits the path given to loadROM into the path of the dataset and the game
+void split_rom_game_path(const std::string &rom_file, std::string &path, std::string &game);
+
+// Opens the store of a game with the resolution, crop and read settings
+// given. Environments that open a game with the same settings share it.
+std::shared_ptr<TrajectoryStore> open_game_store(const std::string &path, const std::string &game,
+        const Settings &settings);
+
+// Maps a frame number to [0, size). Negative numbers count from the end.
+size_t episode_frame(int frame, size_t size);
+
+/**
+   A position in a recorded trajectory. Since trajectories can't be changed by
+   the agent, this is all that is needed to replay them from any point, and
+   copying it takes constant time.
+ */
+class ALEState {
+    friend class ALEInterface;
+public:
+    ALEState() : episode(-1), frame(0), average(false), loadedLast(false) {}
+
+    // Returns the frame number since the start of the episode
+    int getFrameNumber() const { return frame; }
+    int getEpisodeFrameNumber() const { return frame; }
+
+    bool equals(const ALEState &rhs) const {
+        return trajectory == rhs.trajectory && frame == rhs.frame &&
+            average == rhs.average;
+    }
+
+private:
+    std::string trajectory; // Trajectory id in the dataset
+    int episode;            // Episode index, for sequential processing
+    size_t frame;
+    bool average;           // Whether the episode is being colour averaged
+    bool loadedLast;
+};
 
 class ScreenExporter;
 
@@ -94,9 +133,18 @@ public:
     // Indicates if the game has ended.
     bool game_over() const;
 
+    // Whether loadROM() has loaded a game. Screens, frame numbers and
+    // returns are only available once it has.
+    bool isLoaded() const { return atariState != NULL; }
+
     // Resets the game, but not the full system.
     void reset_game();
 
+    // Resets the game into the given frame of the given episode, without
+    // reading the frames before it. Episodes are numbered as in sequential
+    // processing, and negative frames count from the end of the episode.
+    void reset_game_at(int episode, int frame);
+
     // Returns the vector of legal actions. This should be called only
     // after the rom is loaded.
     ActionVect getLegalActionSet();
@@ -117,6 +165,24 @@ public:
     // Returns the frame number since the start of the current episode
     int getEpisodeFrameNumber() const;
 
+    // The action recorded at the current frame, and the one recorded at the
+    // next, or PLAYER_A_NOOP if it isn't in the minimal action set. Same as
+    // getInt("current_action") and getInt("next_action"), without looking
+    // the key up on every step.
+    Action getCurrentAction() const;
+    Action getNextAction() const;
+
+    // The current epoch with epoch_processing, as getInt("current_epoch")
+    int getEpoch() const;
+
+    // Returns the discounted return of every frame of the current episode.
+    // Computed once per episode and discount factor.
+    const std::vector<double> &getEpisodeReturns(double gamma);
+
+    // Returns the n-step discounted return of every frame of the current
+    // episode, for n >= 1. Computed once per episode, discount factor and n.
+    const std::vector<double> &getEpisodeNStepReturns(double gamma, int n);
+
     // Returns the current game screen
     const ALEScreen &getScreen();
 
@@ -129,13 +195,31 @@ public:
     //followed by the green colours and then the blue colours
     void getScreenRGB(std::vector<unsigned char>& output_rgb_buffer);
 
+    // As above, but writing into a caller-owned buffer of height * width
+    // bytes, or three times as many for RGB
+    void getScreenGrayscale(unsigned char *grayscale_output_buffer);
+    void getScreenRGB(unsigned char *output_rgb_buffer);
+
+    // Returns the grayscale screen in place, of height * width bytes: the
+    // pooled screen, the stored frame when screens are already grayscale, or
+    // else a buffer owned by the interface that the screen is decoded into.
+    // Valid until the screen is asked for again, or the interface is
+    // stepped, reset, reloaded, restored or deleted.
+    const unsigned char *getScreenGrayscaleView();
+
+    // With max_pool_last_two enabled, returns the pixel-wise maximum of the
+    // last two frames of the last act() call, as grayscale or, with
+    // max_pool_rgb, interleaved RGB values. The buffer is owned by the
+    // interface and updated in place by act() and the reset methods.
+    const std::vector<unsigned char> &getPooledScreen() const;
+
     // Returns the current RAM content
     const ALERAM &getRAM();
 
     // Saves the state of the system
     void saveState();
 
-    // Loads the state of the system
+    // Loads the state of the system. Does nothing if no state was saved.
     void loadState();
 
     // This makes a copy of the environment state. This copy does *not* include pseudorandomness,
@@ -166,7 +250,8 @@ public:
 
 protected:
     std::unique_ptr<Settings> theSettings;
-    int max_num_frames; // Maximum number of frames for each episode
+    int max_num_frames = 0; // Maximum number of frames over all episodes
+    size_t total_frames = 0; // Frames stepped through since loadROM
     AtariState *atariState = NULL;
     std::string gameName;
     std::string romPath;
@@ -179,9 +264,40 @@ protected:
     bool sequential = false;
     bool display_screen = false;
     DisplayScreen *displayScreen = NULL;
-    H5Wrapper *h5Wrapper = NULL;
+    std::shared_ptr<TrajectoryStore> store;
+    EpisodeCache *episodeCache = NULL;
+    EpisodeSampler *episodeSampler = NULL;
+    std::stack<ALEState> savedStates;
     PhosphorBlend phosphor;
     bool minimalActionCache[PLAYER_B_MAX];
+    Settings::Handle start_frame_min;
+    Settings::Handle start_frame_max;
+
+    std::mt19937 rng;
+    bool max_pool_last_two = false;
+    bool max_pool_rgb = false;
+    std::vector<unsigned char> pooledScreen;
+    std::vector<unsigned char> pooledScratch;
+    // What getScreenGrayscaleView() decodes palette screens into
+    std::vector<unsigned char> grayscaleScreen;
+    // Whether screens hold grayscale values rather than palette indices
+    bool grayscale_screens = false;
+    bool color_averaging = false;
+
+    // Converts a screen to grayscale or interleaved RGB values
+    void decodeScreen(std::vector<unsigned char> &output_buffer, const pixel_t *screen, size_t size, bool rgb);
+    void decodeScreen(unsigned char *output_buffer, const pixel_t *screen, size_t size, bool rgb);
+    // Loads the next episode according to the processing mode
+    AtariState *newAtariState();
+
+    // Starts reading the episode the next reset will load, if it's known
+    void prefetchNextEpisode();
+    // Decodes the current frame into pooledScreen, max-pooling it with the
+    // given previous frame, if they differ
+    void updatePooledScreen(size_t previous_frame);
+    // Moves the current episode to a frame sampled from the interval given by
+    // the start_frame_min and start_frame_max settings
+    void seekStartFrame();
 
 public:
     // Display ALE welcome message
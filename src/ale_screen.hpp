@@ -44,8 +44,9 @@ public:
     /** Access a whole row */
     pixel_t *getRow(int r) const;
 
-    /** Access the whole array */
-    pixel_t *getArray() const { return const_cast<pixel_t *>(&m_pixels[0]); }
+    /** Access the whole array. Screens viewing memory-mapped frames are
+     *  read-only. */
+    pixel_t *getArray() const { return const_cast<pixel_t *>(m_view ? m_view : &m_pixels[0]); }
 
     /** Dimensionality information */
     size_t height() const { return m_rows; }
@@ -62,8 +63,23 @@ protected:
     int m_columns;
 
     std::vector<pixel_t> m_pixels;
+    /** Frame this screen shows in place of m_pixels, if any. Owned by
+     *  whoever set it, and only valid until the screen is updated again. */
+    const pixel_t *m_view = NULL;
+
+    /** Shows the given frame without copying it, or m_pixels again if NULL */
+    void setView(const pixel_t *view) { m_view = view; }
+    /** Copies the viewed frame into m_pixels, so that it can be modified */
+    void materialize();
 };
 
+inline void ALEScreen::materialize() {
+    if (m_view) {
+        m_pixels.assign(m_view, m_view + m_rows * m_columns);
+        m_view = NULL;
+    }
+}
+
 inline ALEScreen::ALEScreen(int h, int w):
         m_rows(h),
         m_columns(w),
@@ -76,6 +92,10 @@ inline ALEScreen::ALEScreen(const ALEScreen &rhs):
         m_columns(rhs.m_columns),
         m_pixels(rhs.m_pixels) {
 
+    // Copies may outlive the viewed frame
+    if (rhs.m_view) {
+        m_pixels.assign(rhs.m_view, rhs.m_view + m_rows * m_columns);
+    }
 }
 
 inline ALEScreen& ALEScreen::operator=(const ALEScreen &rhs) {
@@ -86,6 +106,10 @@ inline ALEScreen& ALEScreen::operator=(const ALEScreen &rhs) {
     // We rely here on the std::vector constructor doing something sensible (i.e. not wasteful)
     // inside its assignment operator
     m_pixels = rhs.m_pixels;
+    m_view = NULL;
+    if (rhs.m_view) {
+        m_pixels.assign(rhs.m_view, rhs.m_view + m_rows * m_columns);
+    }
 
     return *this;
 }
@@ -93,26 +117,27 @@ inline ALEScreen& ALEScreen::operator=(const ALEScreen &rhs) {
 inline bool ALEScreen::equals(const ALEScreen &rhs) const {
     return (m_rows == rhs.m_rows &&
             m_columns == rhs.m_columns &&
-            (memcmp(&m_pixels[0], &rhs.m_pixels[0], arraySize()) == 0) );
+            (memcmp(getArray(), rhs.getArray(), arraySize()) == 0) );
 }
 
 // pixel accessors, (row, column)-ordered
 inline pixel_t ALEScreen::get(int r, int c) const {
     // Perform some bounds-checking
     assert (r >= 0 && r < m_rows && c >= 0 && c < m_columns);
-    return m_pixels[r * m_columns + c];
+    return getArray()[r * m_columns + c];
 }
 
 inline pixel_t* ALEScreen::pixel(int r, int c) {
     // Perform some bounds-checking
     assert (r >= 0 && r < m_rows && c >= 0 && c < m_columns);
+    materialize();
     return &m_pixels[r * m_columns + c];
 }
 
 // Access a whole row
 inline pixel_t* ALEScreen::getRow(int r) const {
     assert (r >= 0 && r < m_rows);
-    return const_cast<pixel_t*>(&m_pixels[r * m_columns]);
+    return getArray() + r * m_columns;
 }
 
 
@@ -0,0 +1,281 @@
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include <zlib.h>
+
+#include "chunk_reader.hpp"
+
+/* Reads in flight at once */
+static const unsigned RING_ENTRIES = 64;
+
+ChunkReader::ChunkReader(const char *path, size_t threads) :
+        ring_fd(-1), sq_ring(MAP_FAILED), cq_ring(MAP_FAILED), sqes(NULL), stopping(false) {
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        throw std::invalid_argument("Unable to open file");
+    }
+
+    // Kernels older than 5.1, and sandboxes, don't have io_uring
+    setupRing(RING_ENTRIES);
+
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    for (size_t i = 0; i < (threads ? threads : 1); i++) {
+        workers.push_back(std::thread(&ChunkReader::work, this));
+    }
+}
+
+ChunkReader::~ChunkReader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    job_ready.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+    closeRing();
+    close(fd);
+}
+
+bool ChunkReader::setupRing(unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring_fd < 0) {
+        return false;
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+    sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    sq_ring = mmap(NULL, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (single_mmap) {
+        cq_ring = sq_ring;
+    } else if (sq_ring != MAP_FAILED) {
+        cq_ring = mmap(NULL, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    }
+    void *map = MAP_FAILED;
+    if (sq_ring != MAP_FAILED && cq_ring != MAP_FAILED) {
+        map = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    }
+    if (map == MAP_FAILED) {
+        closeRing();
+        return false;
+    }
+    sqes = (struct io_uring_sqe *) map;
+
+    uint8_t *sq = (uint8_t *) sq_ring;
+    uint8_t *cq = (uint8_t *) cq_ring;
+    ring_entries = params.sq_entries;
+    sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+    sq_array = (unsigned *) (sq + params.sq_off.array);
+    cq_head = (unsigned *) (cq + params.cq_off.head);
+    cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+    return true;
+}
+
+void ChunkReader::closeRing() {
+    if (sqes != NULL) {
+        munmap(sqes, sqes_size);
+        sqes = NULL;
+    }
+    if (cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+    }
+    if (sq_ring != MAP_FAILED) {
+        munmap(sq_ring, sq_ring_size);
+    }
+    sq_ring = cq_ring = MAP_FAILED;
+    if (ring_fd >= 0) {
+        close(ring_fd);
+        ring_fd = -1;
+    }
+}
+
+/* Hands a chunk read in full to the workers, or takes it as it is if it
+ * isn't compressed (it was then read straight into its output). */
+void ChunkReader::enqueue(const chunk_request_t &request, const uint8_t *buffer, batch_t &batch) {
+    if (!request.compressed) {
+        return;
+    }
+    job_t job = {buffer, request.size, request.out, request.out_size, &batch};
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(job);
+        batch.pending++;
+    }
+    job_ready.notify_one();
+}
+
+/* Waits for the inflates of a batch to be done */
+void ChunkReader::wait(batch_t &batch) {
+    std::unique_lock<std::mutex> lock(mutex);
+    jobs_done.wait(lock, [&batch] { return batch.pending == 0; });
+}
+
+/* Finishes a read the kernel cut short after `done` bytes */
+bool ChunkReader::readComplete(chunk_request_t &request, uint8_t *buffer, size_t done, batch_t &batch) {
+    while (done < request.size) {
+        ssize_t n = pread(fd, buffer + done, request.size - done, request.offset + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+    enqueue(request, buffer, batch);
+    return true;
+}
+
+bool ChunkReader::readRing(std::vector<chunk_request_t> &requests, std::vector<std::vector<uint8_t>> &buffers, batch_t &batch) {
+    std::vector<struct iovec> iovecs(requests.size());
+    size_t next = 0, completed = 0, in_flight = 0;
+    unsigned unsubmitted = 0;
+    bool ok = true;
+
+    while (completed < requests.size()) {
+        // Queue as many reads as the ring holds
+        unsigned tail = *sq_tail;
+        while (next < requests.size() && in_flight < ring_entries) {
+            iovecs[next].iov_base = requests[next].compressed ? &buffers[next][0] : requests[next].out;
+            iovecs[next].iov_len = requests[next].size;
+
+            unsigned index = tail & *sq_mask;
+            struct io_uring_sqe *sqe = &sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READV;
+            sqe->fd = fd;
+            sqe->off = requests[next].offset;
+            sqe->addr = (uint64_t) (uintptr_t) &iovecs[next];
+            sqe->len = 1;
+            sqe->user_data = next;
+            sq_array[index] = index;
+            tail++;
+            next++;
+            in_flight++;
+            unsubmitted++;
+        }
+        __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+
+        int ret = syscall(__NR_io_uring_enter, ring_fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            // Reads in flight still target our buffers, so they have to
+            // complete before the ring and the buffers go
+            drainRing(in_flight - unsubmitted);
+            closeRing();
+            return false;
+        }
+        if (ret > 0) {
+            unsubmitted -= std::min((unsigned) ret, unsubmitted);
+        }
+
+        unsigned head = *cq_head;
+        unsigned ready = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != ready; head++) {
+            const struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+            size_t i = cqe->user_data;
+            uint8_t *buffer = requests[i].compressed ? &buffers[i][0] : requests[i].out;
+            // Failed and short reads are finished with pread
+            ok = readComplete(requests[i], buffer, cqe->res > 0 ? cqe->res : 0, batch) && ok;
+            completed++;
+            in_flight--;
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    return ok;
+}
+
+/* Discards the completions of `submitted` reads, waiting for them */
+void ChunkReader::drainRing(size_t submitted) {
+    while (submitted > 0) {
+        unsigned head = *cq_head;
+        unsigned ready = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        if (head == ready) {
+            // io_uring_enter just failed, and may keep failing, but reads
+            // complete whether it's called or not
+            if (syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+                    errno != EINTR) {
+                usleep(100);
+            }
+            continue;
+        }
+        submitted -= std::min((size_t) (ready - head), submitted);
+        __atomic_store_n(cq_head, ready, __ATOMIC_RELEASE);
+    }
+}
+
+bool ChunkReader::read(std::vector<chunk_request_t> &requests) {
+    std::vector<std::vector<uint8_t>> buffers(requests.size());
+    for (size_t i = 0; i < requests.size(); i++) {
+        if (requests[i].compressed) {
+            buffers[i].resize(requests[i].size ? requests[i].size : 1);
+        } else if (requests[i].size > requests[i].out_size) {
+            return false;
+        }
+    }
+
+    batch_t batch = {0, false};
+    bool ok;
+    {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        ok = ring_fd >= 0 && readRing(requests, buffers, batch);
+    }
+    if (!ok) {
+        // Without io_uring, or if it failed, reads are issued one at a time.
+        // Chunks read before a failure are read again once their inflates
+        // are done.
+        wait(batch);
+        batch.failed = false;
+        ok = true;
+        for (size_t i = 0; i < requests.size() && ok; i++) {
+            ok = readComplete(requests[i], requests[i].compressed ? &buffers[i][0] : requests[i].out, 0, batch);
+        }
+    }
+
+    wait(batch);
+    return ok && !batch.failed;
+}
+
+void ChunkReader::work() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        job_ready.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (jobs.empty()) {
+            return;
+        }
+        job_t job = jobs.front();
+        jobs.pop_front();
+        lock.unlock();
+
+        uLongf size = job.out_size;
+        bool ok = uncompress(job.out, &size, job.in, job.in_size) == Z_OK && size == job.out_size;
+
+        lock.lock();
+        job.batch->failed = job.batch->failed || !ok;
+        if (--job.batch->pending == 0) {
+            jobs_done.notify_all();
+        }
+    }
+}
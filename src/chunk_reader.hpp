@@ -0,0 +1,101 @@
+#ifndef ALE_ATARI_GRAND_CHALLENGE_CHUNK_READER_HPP
+#define ALE_ATARI_GRAND_CHALLENGE_CHUNK_READER_HPP
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+
+/* A chunk of a dataset stored in a file, and where to put it once decoded */
+struct chunk_request_t {
+    uint64_t offset;
+    uint64_t size;
+    /* Whether the chunk went through the deflate filter */
+    bool compressed;
+    uint8_t *out;
+    size_t out_size;
+};
+
+/*
+ * Reads raw chunks of an HDF5 file without going through HDF5, given their
+ * addresses (from H5Dget_chunk_info). Reads of a batch are all issued at once
+ * through io_uring, so that deep queues keep the disks busy, or one at a time
+ * with pread if the kernel doesn't support io_uring. Compressed chunks are
+ * inflated on worker threads as their reads complete.
+ */
+class ChunkReader {
+private:
+    ChunkReader();
+    ChunkReader(const ChunkReader &);
+    ChunkReader &operator=(const ChunkReader &);
+
+    int fd;
+
+    /* io_uring submission and completion rings, mapped from the kernel */
+    int ring_fd;
+    unsigned ring_entries;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /* Serializes the use of the ring by concurrent reads */
+    std::mutex ring_mutex;
+
+    /* Inflates left and whether one failed, for the requests of one read() */
+    struct batch_t {
+        size_t pending;
+        bool failed;
+    };
+    /* Inflate jobs, shared with the workers */
+    struct job_t {
+        const uint8_t *in;
+        size_t in_size;
+        uint8_t *out;
+        size_t out_size;
+        batch_t *batch;
+    };
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable job_ready;
+    std::condition_variable jobs_done;
+    std::deque<job_t> jobs;
+    bool stopping;
+
+    bool setupRing(unsigned entries);
+    void closeRing();
+    bool readRing(std::vector<chunk_request_t> &requests, std::vector<std::vector<uint8_t>> &buffers, batch_t &batch);
+    void drainRing(size_t submitted);
+    bool readComplete(chunk_request_t &request, uint8_t *buffer, size_t done, batch_t &batch);
+    void enqueue(const chunk_request_t &request, const uint8_t *buffer, batch_t &batch);
+    void wait(batch_t &batch);
+    void work();
+
+public:
+    /* Uses `threads` inflate workers, or one per core if 0 */
+    ChunkReader(const char *path, size_t threads = 0);
+    ~ChunkReader();
+
+    /* Reads and decodes every request. Returns whether they all succeeded.
+     * Can be called from several threads at once, which share the inflate
+     * workers and take turns at the ring. */
+    bool read(std::vector<chunk_request_t> &requests);
+
+    bool usesIoUring() const {
+        return ring_fd >= 0;
+    }
+};
+
+#endif //ALE_ATARI_GRAND_CHALLENGE_CHUNK_READER_HPP
@@ -0,0 +1,307 @@
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include "episode.hpp"
+
+Episode::Episode(const std::shared_ptr<TrajectoryStore> &store, const
+        std::string &game, const std::string &id, size_t max_frames) :
+        store(store), game(game), id(id), mapped(NULL), stride(1),
+        predecessors(false), read_ahead(1) {
+
+    hsize_t mapped_frames = 0;
+    IOScheduler::instance().run([&]() {
+        events = store->get_event_columns(
+            game, id, EVENT_ACTION | EVENT_REWARD, max_frames ? max_frames : (hsize_t) -1
+        );
+        mapped = store->map_screens(game, id, mapped_frames);
+        chunk_frames = store->get_chunk_frames(game, id);
+    });
+    if (events.size() == 0 || events.action.size() != events.size() ||
+            events.reward.size() != events.size()) {
+        throw std::runtime_error("Unable to read events of trajectory " + id);
+    }
+    screen_size = store->get_screen_height() * store->get_screen_width();
+    if (mapped_frames < events.size()) {
+        mapped = NULL;
+    }
+    if (mapped == NULL) {
+        screens.resize(events.size());
+        loaded.reset(new std::atomic<bool>[events.size()]());
+    }
+
+    reward_prefix.resize(events.size() + 1);
+    reward_prefix[0] = 0;
+    for (size_t i = 0; i < events.size(); i++) {
+        reward_prefix[i + 1] = reward_prefix[i] + events.reward[i];
+    }
+
+    if (chunk_frames == 0) {
+        chunk_frames = 1;
+    }
+}
+
+void Episode::loadFrames(size_t first, size_t count, size_t step, size_t block) {
+    std::vector<screen_t> chunk = IOScheduler::instance().run([&]() {
+        return store->get_screens(game, id, first, count, step, block);
+    });
+
+    for (size_t i = 0; i < chunk.size(); i++) {
+        size_t frame = first + (i / block) * step + i % block;
+        if (frame < screens.size() && !loaded[frame].load(std::memory_order_relaxed)) {
+            screens[frame].swap(chunk[i]);
+            loaded[frame].store(true, std::memory_order_release);
+        }
+    }
+}
+
+void Episode::loadChunk(size_t frame) {
+    size_t start = frame - frame % chunk_frames;
+    size_t frames = chunk_frames * read_ahead;
+
+    if (stride == 1) {
+        loadFrames(start, std::min(frames, screens.size() - start), 1, 1);
+    } else {
+        // Read the frames observed from here to the end of the last chunk
+        // read in a single strided selection
+        size_t end = std::min(start + frames, screens.size());
+        size_t count = (end - 1 - frame) / stride + 1;
+        if (!predecessors) {
+            loadFrames(frame, count, stride, 1);
+        } else if (frame > 0) {
+            loadFrames(frame - 1, count, stride, 2);
+        } else {
+            loadFrames(0, 1, 1, 1);
+            if (count > 1) {
+                loadFrames(stride - 1, count - 1, stride, 2);
+            }
+        }
+    }
+
+    if (!loaded[frame].load(std::memory_order_relaxed)) {
+        throw std::runtime_error("Unable to read screens of trajectory " + id);
+    }
+}
+
+const std::vector<double> &Episode::getReturns(double gamma) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return computeReturns(gamma);
+}
+
+const std::vector<double> &Episode::computeReturns(double gamma) {
+    std::map<double, std::vector<double>>::iterator it = returns.find(gamma);
+    if (it != returns.end()) {
+        return it->second;
+    }
+
+    std::vector<double> &ret = returns[gamma];
+    ret.resize(events.size());
+    double g = 0;
+    for (size_t i = events.size(); i-- > 0; ) {
+        g = events.reward[i] + gamma * g;
+        ret[i] = g;
+    }
+    return ret;
+}
+
+const std::vector<double> &Episode::getNStepReturns(double gamma, size_t n) {
+    if (n < 1) {
+        throw std::invalid_argument("n-step returns need at least one step");
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    std::pair<double, size_t> key(gamma, n);
+    std::map<std::pair<double, size_t>, std::vector<double>>::iterator it = nstep_returns.find(key);
+    if (it != nstep_returns.end()) {
+        return it->second;
+    }
+
+    // Slides an n-frame window back over the rewards: each step discounts
+    // the window, adds the reward entering it and drops the one leaving it.
+    // The sum never grows past the n rewards it covers, so long episodes
+    // don't lose precision to the difference of two large full returns.
+    std::vector<double> &ret = nstep_returns[key];
+    ret.resize(events.size());
+    double discount = std::pow(gamma, (double) n);
+    double g = 0;
+    for (size_t i = events.size(); i-- > 0; ) {
+        g = events.reward[i] + gamma * g;
+        if (i + n < events.size()) {
+            g -= discount * events.reward[i + n];
+        }
+        ret[i] = g;
+    }
+    return ret;
+}
+
+EpisodeRegistry &EpisodeRegistry::instance() {
+    static EpisodeRegistry registry;
+    return registry;
+}
+
+/* Stores are closed by the scheduler too, since it owns their handles */
+static void close_store(TrajectoryStore *store) {
+    IOScheduler::instance().run([store]() {
+        delete store;
+    });
+}
+
+std::shared_ptr<TrajectoryStore> EpisodeRegistry::getStore(const std::string &key,
+        const std::function<TrajectoryStore *()> &open) {
+    std::lock_guard<std::mutex> lock(store_mutex);
+    std::shared_ptr<TrajectoryStore> store = stores[key].lock();
+    if (!store) {
+        store = std::shared_ptr<TrajectoryStore>(IOScheduler::instance().run(open), close_store);
+        stores[key] = store;
+    }
+    return store;
+}
+
+std::shared_ptr<Episode> EpisodeRegistry::load(const std::shared_ptr<TrajectoryStore> &store, const key_t &key) {
+    std::shared_ptr<Episode> ret;
+    try {
+        ret = std::make_shared<Episode>(store, std::get<1>(key), std::get<2>(key), std::get<3>(key));
+        ret->setStride(std::get<4>(key), std::get<5>(key));
+        ret->setReadAhead(std::get<6>(key));
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        loading.erase(key);
+        throw;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    // Forget the episodes no one holds anymore
+    for (std::map<key_t, std::weak_ptr<Episode>>::iterator it = episodes.begin(); it != episodes.end(); ) {
+        if (it->second.expired()) {
+            episodes.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+    episodes[key] = ret;
+    loading.erase(key);
+    return ret;
+}
+
+std::shared_future<std::shared_ptr<Episode>> EpisodeRegistry::requestEpisode(
+        const std::shared_ptr<TrajectoryStore> &store, const std::string &game, const std::string &id,
+        size_t max_frames, size_t stride, bool predecessors, size_t read_ahead, io_priority_t priority) {
+    key_t key(store.get(), game, id, max_frames, stride, predecessors, read_ahead);
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<key_t, std::weak_ptr<Episode>>::iterator it = episodes.find(key);
+    if (it != episodes.end()) {
+        std::shared_ptr<Episode> ret = it->second.lock();
+        if (ret) {
+            std::promise<std::shared_ptr<Episode>> resident;
+            resident.set_value(ret);
+            return resident.get_future().share();
+        }
+        episodes.erase(it);
+    }
+    std::map<key_t, pending_t>::iterator pending = loading.find(key);
+    if (pending != loading.end()) {
+        IOScheduler::instance().promote(pending->second.second, priority);
+        return pending->second.first;
+    }
+
+    // The read only registers the episode once it gets the lock, so it
+    // can't finish before it is in `loading`
+    uint64_t ticket;
+    std::shared_future<std::shared_ptr<Episode>> ret = IOScheduler::instance().submit([this, store, key]() {
+        return load(store, key);
+    }, priority, IOScheduler::clock::time_point::max(), &ticket).share();
+    loading[key] = pending_t(ret, ticket);
+    return ret;
+}
+
+EpisodeCache::EpisodeCache(const std::shared_ptr<TrajectoryStore> &store,
+        const std::string &game, size_t capacity, size_t max_frames, const EpisodeQuery &query) :
+        store(store), game(game), query(query), capacity(capacity ? capacity : 1),
+        max_frames(max_frames), stride(1), predecessors(false), read_ahead(1) {
+    trajectories = IOScheduler::instance().run([&]() {
+        return select_trajectories(*store, game, query);
+    });
+}
+
+std::vector<haddr_t> EpisodeCache::getTrajectoryLocations() {
+    return IOScheduler::instance().run([&]() {
+        std::vector<haddr_t> locations;
+        select_trajectories(*store, game, query, &locations);
+        return locations;
+    });
+}
+
+EpisodeCache::~EpisodeCache() {
+    dropPrefetched();
+}
+
+void EpisodeCache::dropPrefetched() {
+    for (std::list<std::pair<std::string, std::shared_future<std::shared_ptr<Episode>>>>::iterator it =
+            prefetched.begin(); it != prefetched.end(); ++it) {
+        it->second.wait();
+    }
+    IOScheduler::instance().barrier();
+    prefetched.clear();
+}
+
+void EpisodeCache::setStride(size_t stride, bool predecessors) {
+    this->stride = stride ? stride : 1;
+    this->predecessors = predecessors;
+    episodes.clear();
+    dropPrefetched();
+}
+
+void EpisodeCache::setReadAhead(size_t chunks) {
+    read_ahead = chunks ? chunks : 1;
+    episodes.clear();
+    dropPrefetched();
+}
+
+std::shared_ptr<Episode> EpisodeCache::get(const std::string &id) {
+    for (std::list<std::shared_ptr<Episode>>::iterator it = episodes.begin(); it != episodes.end(); ++it) {
+        if ((*it)->getId() == id) {
+            std::shared_ptr<Episode> ret = *it;
+            episodes.erase(it);
+            episodes.push_front(ret);
+            return ret;
+        }
+    }
+
+    // A prefetch still queued is promoted by asking for the episode again
+    std::shared_ptr<Episode> ret = EpisodeRegistry::instance().getEpisode(
+        store, game, id, max_frames, stride, predecessors, read_ahead
+    );
+    for (std::list<std::pair<std::string, std::shared_future<std::shared_ptr<Episode>>>>::iterator it =
+            prefetched.begin(); it != prefetched.end(); ++it) {
+        if (it->first == id) {
+            prefetched.erase(it);
+            break;
+        }
+    }
+    episodes.push_front(ret);
+    if (episodes.size() > capacity) {
+        episodes.pop_back();
+    }
+    return ret;
+}
+
+void EpisodeCache::prefetch(const std::string &id) {
+    for (std::list<std::shared_ptr<Episode>>::iterator it = episodes.begin(); it != episodes.end(); ++it) {
+        if ((*it)->getId() == id) {
+            return;
+        }
+    }
+    for (std::list<std::pair<std::string, std::shared_future<std::shared_ptr<Episode>>>>::iterator it =
+            prefetched.begin(); it != prefetched.end(); ++it) {
+        if (it->first == id) {
+            return;
+        }
+    }
+
+    prefetched.push_back(std::make_pair(id, EpisodeRegistry::instance().requestEpisode(
+        store, game, id, max_frames, stride, predecessors, read_ahead, IO_PRIORITY_PREFETCH
+    )));
+    if (prefetched.size() > capacity) {
+        prefetched.front().second.wait();
+        prefetched.pop_front();
+    }
+}
@@ -0,0 +1,278 @@
+#ifndef ALE_ATARI_GRAND_CHALLENGE_EPISODE_HPP
+#define ALE_ATARI_GRAND_CHALLENGE_EPISODE_HPP
+
+#include <map>
+#include <list>
+#include <mutex>
+#include <tuple>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "trajectory_store.hpp"
+#include "io_scheduler.hpp"
+#include "episode_query.hpp"
+
+/*
+ * A trajectory of the dataset. Events are read when the episode is created,
+ * but screens are only read, one chunk at a time, when first accessed. Hence,
+ * starting anywhere in an episode costs a single chunk decode. With a stride,
+ * only the frames of the chunk that will be observed are kept. Episodes can be
+ * truncated, in which case nothing past the truncation point is ever read.
+ *
+ * Episodes are shared by every EpisodeCache of the process (see
+ * EpisodeRegistry), so they don't change once read, and the lazy screen reads
+ * are safe to make from several threads.
+ */
+class Episode {
+private:
+    Episode();
+    std::shared_ptr<TrajectoryStore> store;
+    std::string game;
+    std::string id;
+    /* Only the actions and rewards of the event table are read */
+    agcd_events_t events;
+    /* Screens not read yet are empty */
+    std::vector<screen_t> screens;
+    /* Whether screens[i] has been read, so it can be tested without the
+     * lock */
+    std::unique_ptr<std::atomic<bool>[]> loaded;
+    /* Serializes screen reads and the computation of returns */
+    std::mutex mutex;
+    /* Screens mapped in place by the store, if it can */
+    const pixel_t *mapped;
+    size_t screen_size;
+    size_t chunk_frames;
+    /* Frames observed are `stride` frames apart, and need their predecessor
+     * too when `predecessors` is set */
+    size_t stride;
+    bool predecessors;
+    /* Chunks read at once */
+    size_t read_ahead;
+    /* reward_prefix[i] is the sum of the rewards of the first i frames */
+    std::vector<long long> reward_prefix;
+    /* Discounted returns, per discount factor */
+    std::map<double, std::vector<double>> returns;
+    /* n-step discounted returns, per discount factor and number of steps */
+    std::map<std::pair<double, size_t>, std::vector<double>> nstep_returns;
+
+    void loadFrames(size_t first, size_t count, size_t step, size_t block);
+    void loadChunk(size_t frame);
+    const std::vector<double> &computeReturns(double gamma);
+
+public:
+    /* Only the first `max_frames` frames are read, unless it's 0 */
+    Episode(const std::shared_ptr<TrajectoryStore> &store, const std::string &game, const std::string &id,
+            size_t max_frames = 0);
+
+    const std::string &getId() const {
+        return id;
+    }
+
+    /* Number of frames in the episode */
+    size_t size() const {
+        return events.size();
+    }
+
+    int getAction(size_t frame) const {
+        return events.action[frame];
+    }
+
+    int getReward(size_t frame) const {
+        return events.reward[frame];
+    }
+
+    /* Makes screen reads skip the frames that will not be observed when
+     * stepping `stride` frames at a time. The frame before each observed one
+     * is still read if `predecessors` is set, for color averaging or max
+     * pooling. Frames are read on demand either way, so this only affects
+     * how much is read ahead. Only meant to be called before the episode is
+     * shared. */
+    void setStride(size_t stride, bool predecessors) {
+        this->stride = stride ? stride : 1;
+        this->predecessors = predecessors;
+    }
+
+    /* Makes screen reads cover `chunks` chunks at once, starting with the one
+     * asked for, so that stores that batch reads get more to work with. Only
+     * meant to be called before the episode is shared. */
+    void setReadAhead(size_t chunks) {
+        read_ahead = chunks ? chunks : 1;
+    }
+
+    /* Returns the screen at a frame, of getScreenSize() pixels. Valid as long
+     * as the episode is. */
+    const pixel_t *getScreen(size_t frame) {
+        if (mapped != NULL) {
+            return mapped + frame * screen_size;
+        }
+        if (!loaded[frame].load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!loaded[frame].load(std::memory_order_relaxed)) {
+                loadChunk(frame);
+            }
+        }
+        return &screens[frame][0];
+    }
+
+    size_t getScreenSize() const {
+        return screen_size;
+    }
+
+    /* Whether screens are served in place from memory the store maps, which
+     * outlives the episode */
+    bool isMapped() const {
+        return mapped != NULL;
+    }
+
+    /* Sum of the rewards seen by stepping `count` times from `frame`. Like
+     * AtariState::step(), stepping stops at the last frame, whose reward is
+     * then seen again on each step. */
+    long long getRewardSum(size_t frame, size_t count) const {
+        size_t last = size() - 1;
+        size_t end = frame + count;
+        if (end <= last) {
+            return reward_prefix[end] - reward_prefix[frame];
+        }
+        return reward_prefix[last] - reward_prefix[frame] +
+            (long long) (end - last) * events.reward[last];
+    }
+
+    /* Monte-Carlo returns G[t] = r[t] + gamma * G[t + 1] of every frame.
+     * Computed on first use and kept with the episode. */
+    const std::vector<double> &getReturns(double gamma);
+
+    /* n-step returns r[t] + ... + gamma^(n - 1) * r[t + n - 1], truncated at
+     * the end of the episode, for n >= 1. Computed on first use and kept
+     * with the episode. */
+    const std::vector<double> &getNStepReturns(double gamma, size_t n);
+};
+
+/*
+ * Shares stores and episodes between the ALEInterfaces of the process. Stores
+ * opened with the same settings are the same store, and an episode of a store
+ * is only read once, however many caches ask for it, and stays in memory as
+ * long as anything holds it. Requests for an episode that is being read wait
+ * for that read instead of starting another one.
+ *
+ * Stores are opened, read and closed on the IOScheduler, which owns all of
+ * them.
+ */
+class EpisodeRegistry {
+private:
+    /* Store, game, trajectory id, max_frames, stride, predecessors and
+     * read-ahead */
+    typedef std::tuple<const TrajectoryStore *, std::string, std::string, size_t, size_t, bool, size_t> key_t;
+    /* An episode being read, and its IOScheduler ticket */
+    typedef std::pair<std::shared_future<std::shared_ptr<Episode>>, uint64_t> pending_t;
+
+    std::mutex mutex;
+    std::mutex store_mutex;
+    /* Guarded by store_mutex */
+    std::map<std::string, std::weak_ptr<TrajectoryStore>> stores;
+    std::map<key_t, std::weak_ptr<Episode>> episodes;
+    std::map<key_t, pending_t> loading;
+
+    EpisodeRegistry() {
+    }
+
+    std::shared_ptr<Episode> load(const std::shared_ptr<TrajectoryStore> &store, const key_t &key);
+
+public:
+    static EpisodeRegistry &instance();
+
+    /* Returns the live store opened with the given key, or the one `open`
+     * returns (and is then owned by the registry) if there's none. `open`
+     * runs on the IOScheduler. */
+    std::shared_ptr<TrajectoryStore> getStore(const std::string &key, const std::function<TrajectoryStore *()> &open);
+
+    /* Returns the future of the episode of a store read with the given
+     * settings (see Episode), reading it with the given priority if no one
+     * holds it. Reads already queued with a lower priority are promoted. */
+    std::shared_future<std::shared_ptr<Episode>> requestEpisode(const std::shared_ptr<TrajectoryStore> &store,
+            const std::string &game, const std::string &id, size_t max_frames, size_t stride, bool predecessors,
+            size_t read_ahead, io_priority_t priority);
+
+    std::shared_ptr<Episode> getEpisode(const std::shared_ptr<TrajectoryStore> &store, const std::string &game,
+            const std::string &id, size_t max_frames, size_t stride, bool predecessors, size_t read_ahead) {
+        return requestEpisode(
+            store, game, id, max_frames, stride, predecessors, read_ahead, IO_PRIORITY_BLOCKING
+        ).get();
+    }
+};
+
+/*
+ * Keeps the most recently used episodes of a game resident, so that
+ * switching back to one of them (e.g., when restoring a state) neither reads
+ * its events again nor decodes the screens it has already read. Episodes come
+ * from the EpisodeRegistry, so they are shared with the other caches of the
+ * process.
+ */
+class EpisodeCache {
+private:
+    EpisodeCache();
+    std::shared_ptr<TrajectoryStore> store;
+    std::string game;
+    /* Trajectories selected by the query, read once */
+    EpisodeQuery query;
+    game_vector_pair_t trajectories;
+    size_t capacity;
+    size_t max_frames;
+    size_t stride;
+    bool predecessors;
+    size_t read_ahead;
+    /* Most recently used first */
+    std::list<std::shared_ptr<Episode>> episodes;
+    /* Episodes being prefetched, oldest first */
+    std::list<std::pair<std::string, std::shared_future<std::shared_ptr<Episode>>>> prefetched;
+
+    /* Drops the prefetched episodes once they have been read, so that
+     * nothing the scheduler runs still holds the store */
+    void dropPrefetched();
+
+public:
+    /* Episodes are truncated to `max_frames` frames, unless it's 0. Only the
+     * trajectories the query selects are played. */
+    EpisodeCache(const std::shared_ptr<TrajectoryStore> &store, const std::string &game, size_t capacity,
+            size_t max_frames = 0, const EpisodeQuery &query = EpisodeQuery());
+
+    ~EpisodeCache();
+
+    /* Returns the episode with the given trajectory id, reading it if it
+     * isn't resident */
+    std::shared_ptr<Episode> get(const std::string &id);
+
+    /* Starts reading the episode with the given trajectory id in the
+     * background, with a low priority, so that a later get() finds it
+     * resident. At most `capacity` episodes are prefetched at once. */
+    void prefetch(const std::string &id);
+
+    /* Sets the stride of the episodes read later, dropping the resident and
+     * prefetched ones. See Episode::setStride(). */
+    void setStride(size_t stride, bool predecessors);
+
+    /* Sets the read-ahead of the episodes read later, dropping the resident
+     * and prefetched ones. See Episode::setReadAhead(). */
+    void setReadAhead(size_t chunks);
+
+    TrajectoryStore &getStore() {
+        return *store;
+    }
+
+    /* Ids and lengths of the trajectories selected, in the query's order */
+    const game_vector_pair_t &getTrajectories() const {
+        return trajectories;
+    }
+
+    /* File locations of the trajectories selected, in the same order */
+    std::vector<haddr_t> getTrajectoryLocations();
+
+    const std::string &getGame() const {
+        return game;
+    }
+};
+
+#endif //ALE_ATARI_GRAND_CHALLENGE_EPISODE_HPP
@@ -0,0 +1,164 @@
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "episode_query.hpp"
+
+static std::string trim(const std::string &str) {
+    std::string::size_type first = str.find_first_not_of(" \t");
+    if (first == std::string::npos) {
+        return std::string();
+    }
+    return str.substr(first, str.find_last_not_of(" \t") - first + 1);
+}
+
+EpisodeQuery::EpisodeQuery(const std::string &filter, const std::string &order) :
+        ordered(false), order(FIELD_SCORE), descending(false) {
+    std::istringstream clauses(filter);
+    std::string clause;
+    while (std::getline(clauses, clause, ',')) {
+        clause = trim(clause);
+        if (clause.empty()) {
+            continue;
+        }
+        std::string::size_type op = clause.find_first_of("<>=!");
+        if (op == std::string::npos) {
+            throw std::invalid_argument("No comparison in episode filter " + clause);
+        }
+        std::string::size_type value = clause.find_first_not_of("<>=!", op);
+        condition_t condition;
+        condition.field = parseField(trim(clause.substr(0, op)));
+        condition.comparison = clause.substr(op, value == std::string::npos ? value : value - op);
+        if (condition.comparison != "<" && condition.comparison != "<=" && condition.comparison != ">" &&
+                condition.comparison != ">=" && condition.comparison != "==" && condition.comparison != "!=") {
+            throw std::invalid_argument("Invalid comparison in episode filter " + clause);
+        }
+
+        std::string number = value == std::string::npos ? "" : trim(clause.substr(value));
+        condition.percentile = !number.empty() && number[0] == 'p';
+        if (condition.percentile) {
+            number = number.substr(1);
+        }
+        char *end;
+        condition.value = strtod(number.c_str(), &end);
+        if (number.empty() || *end != '\0' ||
+                (condition.percentile && (condition.value < 0 || condition.value > 100))) {
+            throw std::invalid_argument("Invalid value in episode filter " + clause);
+        }
+        conditions.push_back(condition);
+    }
+
+    std::string field = trim(order);
+    if (!field.empty()) {
+        descending = field[0] == '-';
+        this->order = parseField(trim(field.substr(descending ? 1 : 0)));
+        ordered = true;
+    }
+}
+
+EpisodeQuery::field_t EpisodeQuery::parseField(const std::string &name) {
+    if (name == "score") {
+        return FIELD_SCORE;
+    }
+    if (name == "length") {
+        return FIELD_LENGTH;
+    }
+    if (name == "reward") {
+        return FIELD_REWARD;
+    }
+    throw std::invalid_argument("Unknown episode field " + name);
+}
+
+double EpisodeQuery::fieldValue(const trajectory_summary_t &summary, field_t field) {
+    switch (field) {
+    case FIELD_SCORE:
+        return summary.final_score;
+    case FIELD_LENGTH:
+        return summary.length;
+    default:
+        return summary.total_reward;
+    }
+}
+
+std::vector<size_t> EpisodeQuery::apply(const std::vector<trajectory_summary_t> &summaries) const {
+    // Percentiles are resolved to the value of the field they fall on,
+    // over the whole game, so "p80" keeps the top fifth
+    std::vector<double> thresholds(conditions.size());
+    for (size_t i = 0; i < conditions.size(); i++) {
+        thresholds[i] = conditions[i].value;
+        if (conditions[i].percentile && !summaries.empty()) {
+            std::vector<double> values(summaries.size());
+            for (size_t j = 0; j < summaries.size(); j++) {
+                values[j] = fieldValue(summaries[j], conditions[i].field);
+            }
+            size_t rank = std::min<size_t>(floor(conditions[i].value / 100 * values.size()), values.size() - 1);
+            std::nth_element(values.begin(), values.begin() + rank, values.end());
+            thresholds[i] = values[rank];
+        }
+    }
+
+    std::vector<size_t> ret;
+    for (size_t j = 0; j < summaries.size(); j++) {
+        bool selected = true;
+        for (size_t i = 0; i < conditions.size() && selected; i++) {
+            double value = fieldValue(summaries[j], conditions[i].field);
+            const std::string &comparison = conditions[i].comparison;
+            if (comparison == "<") {
+                selected = value < thresholds[i];
+            } else if (comparison == "<=") {
+                selected = value <= thresholds[i];
+            } else if (comparison == ">") {
+                selected = value > thresholds[i];
+            } else if (comparison == ">=") {
+                selected = value >= thresholds[i];
+            } else if (comparison == "==") {
+                selected = value == thresholds[i];
+            } else {
+                selected = value != thresholds[i];
+            }
+        }
+        if (selected) {
+            ret.push_back(j);
+        }
+    }
+
+    if (ordered) {
+        // Ties stay in id order
+        std::stable_sort(ret.begin(), ret.end(), [&](size_t a, size_t b) {
+            double x = fieldValue(summaries[a], order);
+            double y = fieldValue(summaries[b], order);
+            return descending ? x > y : x < y;
+        });
+    }
+    return ret;
+}
+
+game_vector_pair_t select_trajectories(TrajectoryStore &store, const std::string &game, const EpisodeQuery &query,
+        std::vector<haddr_t> *locations) {
+    game_vector_pair_t trajectories = store.get_trajectories(game);
+    if (locations != NULL) {
+        *locations = store.get_trajectory_locations(game);
+    }
+    if (query.selectsAll()) {
+        return trajectories;
+    }
+
+    std::vector<size_t> selected = query.apply(store.get_trajectory_summaries(game));
+    if (selected.empty() && !trajectories.empty()) {
+        throw std::invalid_argument("No trajectories of " + game + " match the episode filter");
+    }
+    game_vector_pair_t ret;
+    std::vector<haddr_t> selected_locations;
+    for (size_t i = 0; i < selected.size(); i++) {
+        ret.push_back(trajectories[selected[i]]);
+        if (locations != NULL) {
+            selected_locations.push_back((*locations)[selected[i]]);
+        }
+    }
+    if (locations != NULL) {
+        locations->swap(selected_locations);
+    }
+    return ret;
+}
@@ -0,0 +1,71 @@
+#ifndef ALE_ATARI_GRAND_CHALLENGE_EPISODE_QUERY_HPP
+#define ALE_ATARI_GRAND_CHALLENGE_EPISODE_QUERY_HPP
+
+#include <string>
+#include <vector>
+
+#include "trajectory_store.hpp"
+
+/*
+ * Selects and orders the trajectories of a game by their summary (see
+ * trajectory_summary_t), so that environments only play a subset of the
+ * dataset.
+ *
+ * The filter is a comma-separated list of conditions that must all hold,
+ * each a field (`score`, the final score, `length`, in frames, or `reward`,
+ * the total reward), a comparison (<, <=, >, >=, == or !=) and a number or a
+ * percentile of the field over the game: "score>=p80" keeps the top 20% by
+ * score, "length<20000,reward>0" the short episodes with some reward.
+ *
+ * The order is a field, sorted in increasing order, or in decreasing order
+ * if prefixed with '-'. Trajectories are otherwise in id order.
+ */
+class EpisodeQuery {
+private:
+    enum field_t {
+        FIELD_SCORE,
+        FIELD_LENGTH,
+        FIELD_REWARD
+    };
+
+    struct condition_t {
+        field_t field;
+        std::string comparison;
+        double value;
+        /* Whether value is a percentile */
+        bool percentile;
+    };
+
+    std::vector<condition_t> conditions;
+    bool ordered;
+    field_t order;
+    bool descending;
+
+    static field_t parseField(const std::string &name);
+    static double fieldValue(const trajectory_summary_t &summary, field_t field);
+
+public:
+    /* Selects every trajectory, in id order */
+    EpisodeQuery() : ordered(false), order(FIELD_SCORE), descending(false) {
+    }
+
+    /* Throws std::invalid_argument if either is malformed */
+    EpisodeQuery(const std::string &filter, const std::string &order);
+
+    bool selectsAll() const {
+        return conditions.empty() && !ordered;
+    }
+
+    /* Returns the positions, in `summaries`, of the trajectories selected,
+     * in order */
+    std::vector<size_t> apply(const std::vector<trajectory_summary_t> &summaries) const;
+};
+
+/* Returns the trajectories of a game a query selects, in its order, and their
+ * file locations if `locations` isn't NULL. Throws std::invalid_argument if a
+ * filter matches nothing. Reads the store, so is meant to run on the
+ * IOScheduler. */
+game_vector_pair_t select_trajectories(TrajectoryStore &store, const std::string &game, const EpisodeQuery &query,
+        std::vector<haddr_t> *locations = NULL);
+
+#endif //ALE_ATARI_GRAND_CHALLENGE_EPISODE_QUERY_HPP
@@ -0,0 +1,55 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "episode_sampler.hpp"
+
+EpisodeSampler::EpisodeSampler(const game_vector_pair_t &trajectories,
+        const std::vector<haddr_t> &locations, size_t window,
+        unsigned int seed) :
+        trajectories(trajectories), window(window ? window : 1),
+        position(0), epoch(-1), generator(seed) {
+
+    if (trajectories.empty()) {
+        throw std::invalid_argument("No trajectories to sample from");
+    }
+
+    for (size_t i = 0; i < trajectories.size(); i++) {
+        by_location.push_back(i);
+    }
+    if (locations.size() == trajectories.size()) {
+        // Datasets whose location is unknown (HADDR_UNDEF) sort last
+        std::stable_sort(by_location.begin(), by_location.end(),
+            [&locations](size_t a, size_t b) -> bool
+            {
+                return locations[a] < locations[b];
+            }
+        );
+    }
+}
+
+void EpisodeSampler::shuffle() {
+    std::vector<size_t> windows;
+    for (size_t start = 0; start < by_location.size(); start += window) {
+        windows.push_back(start);
+    }
+    std::shuffle(windows.begin(), windows.end(), generator);
+
+    order.clear();
+    for (size_t i = 0; i < windows.size(); i++) {
+        size_t start = windows[i];
+        size_t end = std::min(start + window, by_location.size());
+        size_t first = order.size();
+        order.insert(order.end(), by_location.begin() + start, by_location.begin() + end);
+        std::shuffle(order.begin() + first, order.end(), generator);
+    }
+
+    position = 0;
+    epoch++;
+}
+
+const game_pair_t &EpisodeSampler::next() {
+    if (position >= order.size()) {
+        shuffle();
+    }
+    return trajectories[order[position++]];
+}
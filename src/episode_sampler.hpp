@@ -0,0 +1,58 @@
+#ifndef ALE_ATARI_GRAND_CHALLENGE_EPISODE_SAMPLER_HPP
+#define ALE_ATARI_GRAND_CHALLENGE_EPISODE_SAMPLER_HPP
+
+#include <vector>
+#include <random>
+
+#include "trajectory_store.hpp"
+
+/*
+ * Visits every trajectory of a game exactly once per epoch, in shuffled order.
+ *
+ * Trajectories are sorted by where their screens live in the file and split
+ * into windows of `window` physically adjacent trajectories. Each epoch, the
+ * order of the windows is shuffled, and so is the order of the trajectories
+ * inside each window. Reads for a window thus stay within a small region of
+ * the file, which keeps cold reads mostly sequential.
+ */
+class EpisodeSampler {
+private:
+    EpisodeSampler();
+    game_vector_pair_t trajectories;
+    /* Indices into trajectories, sorted by file location */
+    std::vector<size_t> by_location;
+    /* Visiting order for the current epoch */
+    std::vector<size_t> order;
+    size_t window;
+    size_t position;
+    int epoch;
+    std::mt19937 generator;
+
+    void shuffle();
+
+public:
+    EpisodeSampler(const game_vector_pair_t &trajectories,
+                   const std::vector<haddr_t> &locations,
+                   size_t window, unsigned int seed);
+
+    /* Returns the next trajectory to visit. Starts a new epoch when all
+     * trajectories have been visited */
+    const game_pair_t &next();
+
+    /* Returns the trajectory the next call to next() will return, or NULL
+     * if that call starts a new epoch */
+    const game_pair_t *peek() const {
+        return position < order.size() ? &trajectories[order[position]] : NULL;
+    }
+
+    /* Number of the epoch the last trajectory returned by next() belongs to */
+    int getEpoch() const {
+        return epoch;
+    }
+
+    size_t size() const {
+        return trajectories.size();
+    }
+};
+
+#endif //ALE_ATARI_GRAND_CHALLENGE_EPISODE_SAMPLER_HPP
@@ -3,35 +3,24 @@
 
 #include <map>
 #include <string>
+#include <sstream>
 #include <vector>
 #include <utility>
 #include <iterator>
 #include <algorithm>
 #include <stdexcept>
+#include <cstdint>
+#include <cstring>
 
-#include <hdf5.h>
-
-static const int WIDTH = 160;
-static const int HEIGHT = 210;
-
-struct agcd_trajectory_t {
-    int frame;
-    int reward;
-    int score;
-    int terminal;
-    int action;
-};
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-typedef unsigned char pixel_t;
-typedef std::vector<pixel_t> screen_t;
-
-typedef std::pair<std::vector<screen_t>, std::vector<agcd_trajectory_t>> trajectory_t;
+#include <hdf5.h>
 
-typedef std::pair<std::string, size_t> game_pair_t;
-/* This is a vector of pairs of trajectory names and sizes */
-typedef std::vector<game_pair_t> game_vector_pair_t;
-/* This is what we keep in memory */
-typedef std::map<std::string, game_vector_pair_t> game_trajectory_t;
+#include "trajectory_store.hpp"
+#include "chunk_reader.hpp"
 
 template <typename T>
 static inline std::vector<T> read_dataset(hid_t loc_id, const char *name, hid_t h5datatype) {
@@ -74,36 +63,193 @@ static inline std::vector<T> read_dataset(hid_t loc_id, const char *name, hid_t
     return ret;
 }
 
+/* Reads the first `count` rows of the given column of a dataset, converting
+ * them to `memtype`. Columnar event tables are 1-D, legacy event tables are
+ * {frames, 5} native ints. */
+template <typename T>
+static inline std::vector<T> read_column(hid_t dataset_id, hid_t memtype, hsize_t column, hsize_t count) {
+    hid_t space_id = H5Dget_space(dataset_id);
+    int rank = H5Sget_simple_extent_ndims(space_id);
+    hsize_t dims[2] = {0, 0};
+    H5Sget_simple_extent_dims(space_id, dims, NULL);
+
+    count = std::min(count, dims[0]);
+    std::vector<T> ret(count);
+    if (count == 0 || rank < 1 || rank > 2) {
+        H5Sclose(space_id);
+        return std::vector<T>();
+    }
+
+    hsize_t offset[2] = {0, column};
+    hsize_t counts[2] = {count, 1};
+    H5Sselect_hyperslab(space_id, H5S_SELECT_SET, offset, NULL, counts, NULL);
+    hid_t memspace_id = H5Screate_simple(1, counts, NULL);
+
+    if (H5Dread(dataset_id, memtype, memspace_id, space_id, H5P_DEFAULT, &ret[0]) < 0) {
+        ret.clear();
+    }
+
+    H5Sclose(memspace_id);
+    H5Sclose(space_id);
+
+    return ret;
+}
+
+template <typename T>
+static inline std::vector<T> read_column(hid_t loc_id, const char *name, hid_t memtype, hsize_t count) {
+    hid_t dataset_id = H5Dopen(loc_id, name, H5P_DEFAULT);
+    if (dataset_id < 0) {
+        printf("Something bad happened while reading %s.\n", name);
+        return std::vector<T>();
+    }
+    std::vector<T> ret = read_column<T>(dataset_id, memtype, 0, count);
+    H5Dclose(dataset_id);
+    return ret;
+}
+
+/* Number of frames in the event table at `name`, or 0 if it can't be read */
+static inline hsize_t events_length(hid_t loc_id, const char *name) {
+    H5G_stat_t statbuf;
+    if (H5Gget_objinfo(loc_id, name, false, &statbuf) < 0) {
+        return 0;
+    }
+
+    hid_t dataset_id;
+    if (statbuf.type == H5G_GROUP) {
+        dataset_id = H5Dopen(loc_id, (std::string(name) + "/action").c_str(), H5P_DEFAULT);
+    } else {
+        dataset_id = H5Dopen(loc_id, name, H5P_DEFAULT);
+    }
+    if (dataset_id < 0) {
+        return 0;
+    }
+
+    hid_t space_id = H5Dget_space(dataset_id);
+    hsize_t dims[2] = {0, 0};
+    H5Sget_simple_extent_dims(space_id, dims, NULL);
+    H5Sclose(space_id);
+    H5Dclose(dataset_id);
+
+    return dims[0];
+}
+
+/* Reads the requested columns (a mask of event_column_t) of the first
+ * `count` frames of an event table. Event tables are either groups of
+ * narrow columns, as written by agcd-to-hdf5, or {frames, 5} int datasets,
+ * as written by older versions of it. */
+static inline agcd_events_t read_events(hid_t loc_id, const char *name, int columns, hsize_t count) {
+    agcd_events_t events;
+    H5G_stat_t statbuf;
+
+    if (H5Gget_objinfo(loc_id, name, false, &statbuf) < 0) {
+        printf("Something bad happened while reading %s.\n", name);
+        return events;
+    }
+
+    events.length = std::min(count, events_length(loc_id, name));
+
+    if (statbuf.type == H5G_GROUP) {
+        std::string prefix = std::string(name) + "/";
+        if (columns & EVENT_FRAME) {
+            // Frames are implied by the position in the table
+            for (size_t i = 0; i < events.length; i++) {
+                events.frame.push_back(i);
+            }
+        }
+        if (columns & EVENT_REWARD) {
+            events.reward = read_column<int>(loc_id, (prefix + "reward").c_str(), H5T_NATIVE_INT, events.length);
+        }
+        if (columns & EVENT_SCORE) {
+            events.score = read_column<int>(loc_id, (prefix + "score_delta").c_str(), H5T_NATIVE_INT, events.length);
+            for (size_t i = 1; i < events.score.size(); i++) {
+                events.score[i] += events.score[i - 1];
+            }
+        }
+        if (columns & EVENT_TERMINAL) {
+            events.terminal = read_column<uint8_t>(loc_id, (prefix + "terminal").c_str(), H5T_NATIVE_UINT8, events.length);
+        }
+        if (columns & EVENT_ACTION) {
+            events.action = read_column<int8_t>(loc_id, (prefix + "action").c_str(), H5T_NATIVE_INT8, events.length);
+        }
+    } else {
+        hid_t dataset_id = H5Dopen(loc_id, name, H5P_DEFAULT);
+        if (columns & EVENT_FRAME) {
+            events.frame = read_column<int>(dataset_id, H5T_NATIVE_INT, 0, events.length);
+        }
+        if (columns & EVENT_REWARD) {
+            events.reward = read_column<int>(dataset_id, H5T_NATIVE_INT, 1, events.length);
+        }
+        if (columns & EVENT_SCORE) {
+            events.score = read_column<int>(dataset_id, H5T_NATIVE_INT, 2, events.length);
+        }
+        if (columns & EVENT_TERMINAL) {
+            events.terminal = read_column<uint8_t>(dataset_id, H5T_NATIVE_UINT8, 3, events.length);
+        }
+        if (columns & EVENT_ACTION) {
+            events.action = read_column<int8_t>(dataset_id, H5T_NATIVE_INT8, 4, events.length);
+        }
+        H5Dclose(dataset_id);
+    }
+
+    return events;
+}
+
+/* Returns where the data of a dataset starts in the file. For chunked
+ * datasets this is the address of the first chunk, for contiguous datasets
+ * the raw data offset. If neither is available, we fall back to the address
+ * of the object header, which is allocated close to the data anyway. */
+static inline haddr_t dataset_location(hid_t loc_id, const char *name) {
+    haddr_t addr = HADDR_UNDEF;
+
+    hid_t dataset_id = H5Dopen(loc_id, name, H5P_DEFAULT);
+    if (dataset_id < 0) {
+        return addr;
+    }
+
+    hid_t plist_id = H5Dget_create_plist(dataset_id);
+    if (H5Pget_layout(plist_id) == H5D_CHUNKED) {
+        hsize_t size;
+        H5E_BEGIN_TRY {
+            if (H5Dget_chunk_info(dataset_id, H5S_ALL, 0, NULL, NULL, &addr, &size) < 0) {
+                addr = HADDR_UNDEF;
+            }
+        } H5E_END_TRY;
+    } else {
+        addr = H5Dget_offset(dataset_id);
+    }
+    H5Pclose(plist_id);
+
+    if (addr == HADDR_UNDEF) {
+        H5O_info_t oinfo;
+        if (H5Oget_info(dataset_id, &oinfo) >= 0) {
+            addr = oinfo.addr;
+        }
+    }
+
+    H5Dclose(dataset_id);
+
+    return addr;
+}
+
 static herr_t trajectory_info_callback(hid_t loc_id, const char *name, const H5L_info_t *info, void *opdata) {
     H5G_stat_t statbuf;
 
     H5Gget_objinfo(loc_id, name, false, &statbuf);
     game_vector_pair_t *v = (game_vector_pair_t *)opdata;
 
-    if (statbuf.type != H5G_DATASET) {
+    if (statbuf.type != H5G_DATASET && statbuf.type != H5G_GROUP) {
         return 0;
     }
 
-    hid_t dataset_id = H5Dopen(loc_id, name, H5P_DEFAULT);
-    hid_t space_id = H5Dget_space(dataset_id);
-
-    size_t rank = H5Sget_simple_extent_ndims(space_id);
-    hsize_t dims[rank];
-    herr_t status = H5Sget_simple_extent_dims(space_id, dims, NULL);
-
-    if (dims[0] == 0) {
+    hsize_t length = events_length(loc_id, name);
+    if (length == 0) {
         fprintf(stderr, "No elements in dataset %s. "
                 "Skipping...\n", name);
-        H5Dclose(dataset_id);
-        H5Sclose(space_id);
     }
 
-    game_pair_t entry(name, dims[0]);
+    game_pair_t entry(name, length);
     v->push_back(entry);
 
-    H5Dclose(dataset_id);
-    H5Sclose(space_id);
-
     return 0;
 }
 
@@ -157,14 +303,222 @@ cleanup_file_info:
     return 0;
 }
 
-class H5Wrapper {
+/* Frame index over all trajectories of a game, as built by agcd-to-hdf5 in
+ * /<game>/global. Frames of trajectory ids[i] have global indices offsets[i]
+ * to offsets[i + 1] - 1. */
+struct global_index_t {
+    std::vector<std::string> ids;
+    std::vector<hsize_t> offsets;
+
+    hsize_t size() const {
+        return offsets.empty() ? 0 : offsets.back();
+    }
+
+    /* Returns the trajectory (an index into ids) holding a global frame, and
+     * sets `frame` to the position of the frame in it */
+    size_t locate(hsize_t global, hsize_t &frame) const {
+        size_t i = std::upper_bound(offsets.begin(), offsets.end(), global) - offsets.begin() - 1;
+        frame = global - offsets[i];
+        return i;
+    }
+};
+
+class H5Wrapper : public TrajectoryStore {
 private:
     H5Wrapper();
     hid_t file_id;
-    const char *hdf_file;
+    /* Copied, as stores outlive whoever opened them and the file is only
+     * mapped on first use */
+    std::string hdf_file;
     std::string current_game;
     bool updating_first = true;
     game_trajectory_t game_trajectories;
+    /* Group the screens are read from */
+    std::string screen_group = "screens";
+    /* The whole file, mapped when contiguous screens are first mapped */
+    const uint8_t *file_map = NULL;
+    size_t file_map_size = 0;
+    /* Global indices and datasets of /<game>/global, opened on first use */
+    std::map<std::string, global_index_t> global_indices;
+    std::map<std::string, hid_t> global_datasets;
+    /* Reads chunks of screens instead of HDF5, if set */
+    ChunkReader *chunk_reader = NULL;
+    /* Trajectory summaries, by game, computed on first use */
+    std::map<std::string, std::vector<trajectory_summary_t>> summaries;
+
+    /* Reads the frames get_screens() asks for of a frame-major dataset with
+     * the chunk reader. Returns false, having read nothing, if the chunks
+     * aren't stored in a way it can decode (deflate or no filter). */
+    bool read_raw_screens(hid_t dataset_id, const hsize_t *dims, hsize_t start, hsize_t count, hsize_t stride,
+            hsize_t block, std::vector<screen_t> &screens) {
+        hid_t plist_id = H5Dget_create_plist(dataset_id);
+        hid_t type_id = H5Dget_type(dataset_id);
+        hsize_t chunk[3] = {0, 0, 0};
+        bool raw = H5Pget_layout(plist_id) == H5D_CHUNKED && H5Tget_size(type_id) == 1 &&
+            H5Pget_chunk(plist_id, 3, chunk) == 3 && chunk[0] > 0 && chunk[1] == dims[1] && chunk[2] == dims[2];
+        int filters = H5Pget_nfilters(plist_id);
+        bool deflate = false;
+        if (raw && filters == 1) {
+            unsigned flags, config;
+            size_t values = 0;
+            deflate = H5Pget_filter2(plist_id, 0, &flags, &values, NULL, 0, NULL, &config) == H5Z_FILTER_DEFLATE;
+            raw = deflate;
+        } else if (filters != 0) {
+            raw = false;
+        }
+        H5Tclose(type_id);
+        H5Pclose(plist_id);
+        if (!raw) {
+            return false;
+        }
+
+        // Frames are in ascending order, as blocks don't overlap
+        std::vector<hsize_t> frames;
+        std::vector<hsize_t> chunks;
+        for (hsize_t i = 0; i < count; i++) {
+            for (hsize_t j = 0; j < block; j++) {
+                frames.push_back(start + i * stride + j);
+                if (chunks.empty() || chunks.back() != frames.back() / chunk[0]) {
+                    chunks.push_back(frames.back() / chunk[0]);
+                }
+            }
+        }
+
+        const size_t frame_size = dims[1] * dims[2];
+        const size_t chunk_size = chunk[0] * frame_size;
+        std::vector<uint8_t> decoded(chunks.size() * chunk_size);
+        std::vector<chunk_request_t> requests;
+        for (size_t i = 0; i < chunks.size(); i++) {
+            hsize_t offset[3] = {chunks[i] * chunk[0], 0, 0};
+            unsigned filter_mask = 0;
+            haddr_t addr = HADDR_UNDEF;
+            hsize_t size = 0;
+            herr_t status;
+            H5E_BEGIN_TRY {
+                status = H5Dget_chunk_info_by_coord(dataset_id, offset, &filter_mask, &addr, &size);
+            } H5E_END_TRY;
+            if (status < 0 || addr == HADDR_UNDEF) {
+                return false;
+            }
+            // Bit 0 of the mask is set when deflate was skipped for a chunk
+            chunk_request_t request = {addr, size, deflate && !(filter_mask & 1), &decoded[i * chunk_size], chunk_size};
+            requests.push_back(request);
+        }
+        if (!chunk_reader->read(requests)) {
+            return false;
+        }
+
+        size_t c = 0;
+        for (size_t i = 0; i < frames.size(); i++) {
+            while (chunks[c] != frames[i] / chunk[0]) {
+                c++;
+            }
+            const pixel_t *p = &decoded[c * chunk_size + (frames[i] - chunks[c] * chunk[0]) * frame_size];
+            screen_t screen(crop_height * crop_width);
+            for (size_t row = 0; row < crop_height; row++) {
+                const pixel_t *q = p + (crop_top + row) * dims[2] + crop_left;
+                std::copy(q, q + crop_width, &screen[row * crop_width]);
+            }
+            screens.push_back(screen);
+        }
+        return true;
+    }
+
+    hid_t open_global(const std::string &game, const std::string &name) {
+        std::string path = "/" + game + "/global/" + name;
+        std::map<std::string, hid_t>::iterator it = global_datasets.find(path);
+        if (it != global_datasets.end()) {
+            return it->second;
+        }
+        hid_t dataset_id = H5Dopen(file_id, path.c_str(), H5P_DEFAULT);
+        if (dataset_id < 0) {
+            printf("Something bad happened while reading %s.\n", path.c_str());
+        } else {
+            global_datasets[path] = dataset_id;
+        }
+        return dataset_id;
+    }
+
+    /* Selects rows `frames` of a global dataset, cropping screens. Virtual
+     * datasets don't support point selections, and unions of hyperslabs are
+     * read in file order, so we select every frame once, in order, coalescing
+     * consecutive ones. Returns the frames selected, in the order they are
+     * read. */
+    std::vector<hsize_t> select_global_frames(hid_t space_id, const std::vector<hsize_t> &frames) {
+        std::vector<hsize_t> sorted(frames);
+        std::sort(sorted.begin(), sorted.end());
+        sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+        hsize_t dims[3] = {0, 0, 0};
+        H5Sget_simple_extent_dims(space_id, dims, NULL);
+        if (!sorted.empty() && sorted.back() >= dims[0]) {
+            throw std::out_of_range("Frame out of the global index");
+        }
+
+        H5Sselect_none(space_id);
+        for (size_t i = 0; i < sorted.size(); ) {
+            size_t run = 1;
+            while (i + run < sorted.size() && sorted[i + run] == sorted[i] + run) {
+                run++;
+            }
+            hsize_t offset[3] = {sorted[i], crop_top, crop_left};
+            hsize_t count[3] = {run, crop_height, crop_width};
+            H5Sselect_hyperslab(space_id, H5S_SELECT_OR, offset, NULL, count, NULL);
+            i += run;
+        }
+
+        return sorted;
+    }
+
+    /* Reads the given global frames of a global event column, in order */
+    template <typename T>
+    std::vector<T> read_global_column(const std::string &game, const char *name, hid_t memtype,
+            const std::vector<hsize_t> &frames) {
+        std::vector<T> ret;
+        hid_t dataset_id = open_global(game, name);
+        if (dataset_id < 0 || frames.empty()) {
+            return ret;
+        }
+        hid_t space_id = H5Dget_space(dataset_id);
+        std::vector<hsize_t> sorted;
+        try {
+            sorted = select_global_frames(space_id, frames);
+        } catch (...) {
+            H5Sclose(space_id);
+            throw;
+        }
+
+        hsize_t count[1] = {sorted.size()};
+        hid_t memspace_id = H5Screate_simple(1, count, NULL);
+        std::vector<T> values(sorted.size());
+        if (H5Dread(dataset_id, memtype, memspace_id, space_id, H5P_DEFAULT, &values[0]) >= 0) {
+            for (size_t i = 0; i < frames.size(); i++) {
+                ret.push_back(values[std::lower_bound(sorted.begin(), sorted.end(), frames[i]) - sorted.begin()]);
+            }
+        }
+        H5Sclose(memspace_id);
+        H5Sclose(space_id);
+        return ret;
+    }
+
+    bool map_file() {
+        int fd = open(hdf_file.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        void *map = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (map == MAP_FAILED) {
+            return false;
+        }
+        file_map = (const uint8_t *) map;
+        file_map_size = st.st_size;
+        return true;
+    }
 
 public:
     H5Wrapper(const char *hdf_file) : hdf_file(hdf_file) {
@@ -180,9 +534,56 @@ public:
     }
 
     ~H5Wrapper() {
+        if (file_map != NULL) {
+            munmap((void *) file_map, file_map_size);
+        }
+        for (std::map<std::string, hid_t>::iterator it = global_datasets.begin(); it != global_datasets.end(); ++it) {
+            H5Dclose(it->second);
+        }
+        delete chunk_reader;
         H5Fclose(file_id);
     }
 
+    /* Makes get_screens() read the grayscale screens downscaled to the given
+     * resolution by agcd-to-hdf5 -r, instead of the palette indices at full
+     * resolution. A resolution of 0x0 goes back to the latter. Resets the
+     * crop rectangle. */
+    void set_resolution(hsize_t height, hsize_t width) {
+        if (height == 0 && width == 0) {
+            screen_group = "screens";
+            screen_height = HEIGHT;
+            screen_width = WIDTH;
+        } else {
+            std::ostringstream ss;
+            ss << "screens_" << height << "x" << width << "_gray";
+            screen_group = ss.str();
+            screen_height = height;
+            screen_width = width;
+        }
+        set_crop(0, 0, screen_height, screen_width);
+    }
+
+    /* Makes get_screens() read the chunks of the screens itself, with
+     * batched asynchronous reads, and inflate them on `threads` workers (one
+     * per core if 0), instead of through HDF5. Legacy and contiguous datasets
+     * are still read by HDF5. */
+    void set_raw_chunk_reads(bool enabled, size_t threads = 0) {
+        delete chunk_reader;
+        chunk_reader = enabled ? new ChunkReader(hdf_file.c_str(), threads) : NULL;
+    }
+
+    /* Whether screens are grayscale values rather than palette indices */
+    bool is_grayscale() const {
+        return screen_group != "screens";
+    }
+
+    /* Whether the screens of a game are stored at the current resolution */
+    bool has_screens(std::string game) {
+        std::string path = "/" + game + "/" + screen_group;
+        return H5Lexists(file_id, ("/" + game).c_str(), H5P_DEFAULT) > 0 &&
+            H5Lexists(file_id, path.c_str(), H5P_DEFAULT) > 0;
+    }
+
     std::vector<std::string> get_games() {
         std::vector<std::string> ret;
 
@@ -207,28 +608,330 @@ public:
         return it->second;
     }
 
-    trajectory_t get_trajectory(std::string game, std::string trajectory_id) {
-        std::vector<agcd_trajectory_t> trajectories;
-        trajectories = read_dataset<agcd_trajectory_t>(
-            file_id, ("/" + game + "/trajectories/" + trajectory_id).c_str(), H5T_NATIVE_INT
+    /* Returns the file location of the screens of each trajectory of a game,
+     * in the same order as get_trajectories() */
+    std::vector<haddr_t> get_trajectory_locations(std::string game) {
+        std::vector<haddr_t> ret;
+        game_vector_pair_t trajectories = get_trajectories(game);
+        for (size_t i = 0; i < trajectories.size(); i++) {
+            ret.push_back(dataset_location(
+                file_id, ("/" + game + "/" + screen_group + "/" + trajectories[i].first).c_str()
+            ));
+        }
+        return ret;
+    }
+
+    /* Reads only the requested columns (a mask of event_column_t) of the
+     * events of a trajectory, stopping after `count` frames */
+    agcd_events_t get_event_columns(std::string game, std::string trajectory_id, int columns,
+            hsize_t count = (hsize_t) -1) {
+        return read_events(
+            file_id, ("/" + game + "/trajectories/" + trajectory_id).c_str(), columns, count
         );
+    }
+
+    /* Reads the requested columns of the events of every trajectory of a
+     * game, in the same order as get_trajectories(). Screen datasets are
+     * never opened, so this is cheap enough to scan whole games for
+     * statistics or to select trajectories. */
+    game_events_t get_game_events(std::string game, int columns) {
+        game_events_t ret;
+        game_vector_pair_t trajectories = get_trajectories(game);
+
+        hid_t group_id = H5Gopen(file_id, ("/" + game + "/trajectories").c_str(), H5P_DEFAULT);
+        if (group_id < 0) {
+            return ret;
+        }
+        for (size_t i = 0; i < trajectories.size(); i++) {
+            ret.push_back(std::make_pair(
+                trajectories[i].first,
+                read_events(group_id, trajectories[i].first.c_str(), columns, (hsize_t) -1)
+            ));
+        }
+        H5Gclose(group_id);
+
+        return ret;
+    }
 
-        std::vector<pixel_t> pixels;
-        pixels = read_dataset<pixel_t>(
-            file_id, ("/" + game + "/screens/" + trajectory_id).c_str(), H5T_NATIVE_UCHAR
+    /* Summaries only depend on the event columns, so they are computed once
+     * per game, however many environments select episodes from it */
+    std::vector<trajectory_summary_t> get_trajectory_summaries(std::string game) {
+        std::map<std::string, std::vector<trajectory_summary_t>>::iterator it = summaries.find(game);
+        if (it == summaries.end()) {
+            it = summaries.insert(std::make_pair(game, TrajectoryStore::get_trajectory_summaries(game))).first;
+        }
+        return it->second;
+    }
+
+    /* Whether the file has a global index of the game, with the screens at
+     * the current resolution */
+    bool has_global_index(std::string game) {
+        std::string path = "/" + game + "/global";
+        return H5Lexists(file_id, ("/" + game).c_str(), H5P_DEFAULT) > 0 &&
+            H5Lexists(file_id, path.c_str(), H5P_DEFAULT) > 0 &&
+            H5Lexists(file_id, (path + "/" + screen_group).c_str(), H5P_DEFAULT) > 0;
+    }
+
+    const global_index_t &get_global_index(std::string game) {
+        std::map<std::string, global_index_t>::iterator it = global_indices.find(game);
+        if (it != global_indices.end()) {
+            return it->second;
+        }
+
+        global_index_t &index = global_indices[game];
+        std::string path = "/" + game + "/global/";
+        std::vector<uint64_t> offsets = read_column<uint64_t>(
+            file_id, (path + "offsets").c_str(), H5T_NATIVE_UINT64, (hsize_t) -1
         );
+        if (offsets.empty()) {
+            return index;
+        }
+
+        hid_t dataset_id = H5Dopen(file_id, (path + "ids").c_str(), H5P_DEFAULT);
+        if (dataset_id < 0) {
+            printf("Something bad happened while reading %sids.\n", path.c_str());
+            return index;
+        }
+        hid_t type_id = H5Dget_type(dataset_id);
+        size_t id_size = H5Tget_size(type_id);
+        std::vector<char> ids(id_size * (offsets.size() - 1) + 1, 0);
+        if (offsets.size() > 1 && H5Dread(dataset_id, type_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, &ids[0]) >= 0) {
+            for (size_t i = 0; i + 1 < offsets.size(); i++) {
+                const char *id = &ids[i * id_size];
+                index.ids.push_back(std::string(id, strnlen(id, id_size)));
+            }
+            index.offsets.assign(offsets.begin(), offsets.end());
+        }
+        H5Tclose(type_id);
+        H5Dclose(dataset_id);
 
+        return index;
+    }
+
+    /* Reads the screens at the given global frames of a game, in the order
+     * given, with a single selection on the virtual dataset of the game.
+     * Screens are cropped as set by set_crop(). */
+    std::vector<screen_t> get_global_screens(std::string game, const std::vector<hsize_t> &frames) {
         std::vector<screen_t> screens;
-        size_t offset = 210 * 160;
-        for (register size_t i = 0; i < pixels.size(); i += offset) {
-            pixel_t *p = &pixels[i];
-            std::vector<pixel_t> tmp(p, p + offset);
-            screens.push_back(tmp);
+        hid_t dataset_id = open_global(game, screen_group);
+        if (dataset_id < 0 || frames.empty()) {
+            return screens;
+        }
+
+        hid_t space_id = H5Dget_space(dataset_id);
+        std::vector<hsize_t> sorted;
+        try {
+            sorted = select_global_frames(space_id, frames);
+        } catch (...) {
+            H5Sclose(space_id);
+            throw;
+        }
+
+        const size_t size = crop_height * crop_width;
+        hsize_t mem_dims[3] = {sorted.size(), crop_height, crop_width};
+        hid_t memspace_id = H5Screate_simple(3, mem_dims, NULL);
+        std::vector<pixel_t> pixels(sorted.size() * size);
+        if (H5Dread(dataset_id, H5T_NATIVE_UCHAR, memspace_id, space_id, H5P_DEFAULT, &pixels[0]) >= 0) {
+            for (size_t i = 0; i < frames.size(); i++) {
+                size_t j = std::lower_bound(sorted.begin(), sorted.end(), frames[i]) - sorted.begin();
+                screens.push_back(screen_t(&pixels[j * size], &pixels[(j + 1) * size]));
+            }
+        } else {
+            printf("Something bad happened while reading the global screens of %s.\n", game.c_str());
+        }
+        H5Sclose(memspace_id);
+        H5Sclose(space_id);
+
+        return screens;
+    }
+
+    /* Reads the requested columns of the events at the given global frames
+     * of a game, in the order given. Frames are numbered within their
+     * trajectory. Scores are stored as deltas, so EVENT_SCORE is not
+     * available here; use get_event_columns() for them. */
+    agcd_events_t get_global_events(std::string game, const std::vector<hsize_t> &frames, int columns) {
+        agcd_events_t events;
+        events.length = frames.size();
+
+        if (columns & EVENT_FRAME) {
+            const global_index_t &index = get_global_index(game);
+            for (size_t i = 0; i < frames.size(); i++) {
+                if (frames[i] >= index.size()) {
+                    throw std::out_of_range("Frame out of the global index");
+                }
+                hsize_t frame;
+                index.locate(frames[i], frame);
+                events.frame.push_back(frame);
+            }
+        }
+        if (columns & EVENT_REWARD) {
+            events.reward = read_global_column<int>(game, "reward", H5T_NATIVE_INT, frames);
+        }
+        if (columns & EVENT_TERMINAL) {
+            events.terminal = read_global_column<uint8_t>(game, "terminal", H5T_NATIVE_UINT8, frames);
+        }
+        if (columns & EVENT_ACTION) {
+            events.action = read_global_column<int8_t>(game, "action", H5T_NATIVE_INT8, frames);
         }
 
-        printf("Trajectories size: %d - Screens size: %d\n", trajectories.size(), screens.size());
+        return events;
+    }
+
+    /* Screens written by agcd-to-hdf5 -u are contiguous and unfiltered, so
+     * their bytes sit in the file as they are in memory, at H5Dget_offset() */
+    const pixel_t *map_screens(std::string game, std::string trajectory_id, hsize_t &frames) {
+        if (is_cropped()) {
+            return NULL;
+        }
+        hid_t dataset_id = H5Dopen(file_id, ("/" + game + "/" + screen_group + "/" + trajectory_id).c_str(), H5P_DEFAULT);
+        if (dataset_id < 0) {
+            return NULL;
+        }
+        hid_t space_id = H5Dget_space(dataset_id);
+        hid_t plist_id = H5Dget_create_plist(dataset_id);
+        hid_t type_id = H5Dget_type(dataset_id);
+
+        hsize_t dims[3] = {0, 0, 0};
+        int rank = H5Sget_simple_extent_ndims(space_id);
+        H5Sget_simple_extent_dims(space_id, dims, NULL);
+        haddr_t offset = HADDR_UNDEF;
+        if (rank == 3 && dims[1] == screen_height && dims[2] == screen_width &&
+                H5Pget_layout(plist_id) == H5D_CONTIGUOUS && H5Pget_nfilters(plist_id) == 0 &&
+                H5Tget_size(type_id) == 1) {
+            offset = H5Dget_offset(dataset_id);
+        }
+
+        H5Tclose(type_id);
+        H5Pclose(plist_id);
+        H5Sclose(space_id);
+        H5Dclose(dataset_id);
+
+        if (offset == HADDR_UNDEF || (file_map == NULL && !map_file()) ||
+                offset > file_map_size || dims[0] * dims[1] * dims[2] > file_map_size - offset) {
+            return NULL;
+        }
+        frames = dims[0];
+        return file_map + offset;
+    }
+
+    /* Returns the number of frames stored in each chunk of the screens of a
+     * trajectory, i.e., the smallest number of frames HDF5 has to decode to
+     * read any single frame. */
+    hsize_t get_chunk_frames(std::string game, std::string trajectory_id) {
+        hid_t dataset_id = H5Dopen(file_id, ("/" + game + "/" + screen_group + "/" + trajectory_id).c_str(), H5P_DEFAULT);
+        if (dataset_id < 0) {
+            return 0;
+        }
+        hid_t space_id = H5Dget_space(dataset_id);
+        hid_t plist_id = H5Dget_create_plist(dataset_id);
+
+        hsize_t dims[3] = {0, 0, 0};
+        hsize_t chunk[3] = {0, 0, 0};
+        int rank = H5Sget_simple_extent_ndims(space_id);
+        H5Sget_simple_extent_dims(space_id, dims, NULL);
+
+        hsize_t ret;
+        if (rank == 3 && dims[1] == screen_height && dims[2] == screen_width &&
+                H5Pget_layout(plist_id) == H5D_CHUNKED) {
+            H5Pget_chunk(plist_id, 3, chunk);
+            ret = chunk[0];
+        } else {
+            /* Legacy {HEIGHT, WIDTH, frames} datasets are a single chunk */
+            ret = H5Sget_simple_extent_npoints(space_id) / (HEIGHT * WIDTH);
+        }
+
+        H5Pclose(plist_id);
+        H5Sclose(space_id);
+        H5Dclose(dataset_id);
+
+        return ret;
+    }
+
+    /* Reads `count` blocks of `block` consecutive screens of a trajectory,
+     * the first starting at frame `start` and each following one `stride`
+     * frames after the previous one. The default reads `count` consecutive
+     * screens. Only the chunks holding the requested frames are read and
+     * decompressed. Blocks that run past the end of the trajectory are not
+     * returned. Screens are cropped as set by set_crop(). */
+    std::vector<screen_t> get_screens(std::string game, std::string trajectory_id, hsize_t start, hsize_t count,
+            hsize_t stride = 1, hsize_t block = 1) {
+        std::vector<screen_t> screens;
+        const size_t offset = crop_height * crop_width;
+        std::string path = "/" + game + "/" + screen_group + "/" + trajectory_id;
+
+        if (stride == 1) {
+            count *= block;
+            block = 1;
+        } else if (block > stride) {
+            throw std::invalid_argument("Blocks of screens cannot overlap");
+        }
+
+        hid_t dataset_id = H5Dopen(file_id, path.c_str(), H5P_DEFAULT);
+        if (dataset_id < 0) {
+            printf("Something bad happened while reading %s.\n", path.c_str());
+            return screens;
+        }
+        hid_t space_id = H5Dget_space(dataset_id);
+
+        hsize_t dims[3] = {0, 0, 0};
+        int rank = H5Sget_simple_extent_ndims(space_id);
+        H5Sget_simple_extent_dims(space_id, dims, NULL);
+
+        if (rank == 3 && dims[1] == screen_height && dims[2] == screen_width) {
+            if (start + block <= dims[0]) {
+                count = std::min(count, (dims[0] - start - block) / stride + 1);
+                if (chunk_reader != NULL && read_raw_screens(dataset_id, dims, start, count, stride, block, screens)) {
+                    H5Sclose(space_id);
+                    H5Dclose(dataset_id);
+                    return screens;
+                }
+                hsize_t file_offset[3] = {start, crop_top, crop_left};
+                hsize_t file_stride[3] = {stride, 1, 1};
+                hsize_t file_count[3] = {count, 1, 1};
+                hsize_t file_block[3] = {block, crop_height, crop_width};
+                H5Sselect_hyperslab(space_id, H5S_SELECT_SET, file_offset, file_stride, file_count, file_block);
+                hsize_t mem_dims[3] = {count * block, crop_height, crop_width};
+                hid_t memspace_id = H5Screate_simple(3, mem_dims, NULL);
+
+                std::vector<pixel_t> pixels(count * block * offset);
+                if (H5Dread(dataset_id, H5T_NATIVE_UCHAR, memspace_id, space_id, H5P_DEFAULT, &pixels[0]) >= 0) {
+                    for (size_t i = 0; i < pixels.size(); i += offset) {
+                        pixel_t *p = &pixels[i];
+                        screens.push_back(screen_t(p, p + offset));
+                    }
+                } else {
+                    printf("Something bad happened while reading %s.\n", path.c_str());
+                }
+                H5Sclose(memspace_id);
+            }
+            H5Sclose(space_id);
+            H5Dclose(dataset_id);
+        } else if (is_grayscale()) {
+            printf("Unexpected dimensions for %s.\n", path.c_str());
+            H5Sclose(space_id);
+            H5Dclose(dataset_id);
+        } else {
+            /* Legacy files declare {HEIGHT, WIDTH, frames}, but store frames
+             * contiguously in a single chunk. No hyperslab maps to a range of
+             * frames, so we read everything and keep what was asked for. */
+            H5Sclose(space_id);
+            H5Dclose(dataset_id);
+
+            std::vector<pixel_t> pixels = read_dataset<pixel_t>(file_id, path.c_str(), H5T_NATIVE_UCHAR);
+            size_t frames = pixels.size() / (HEIGHT * WIDTH);
+            for (size_t i = start; i + block <= frames && i < start + count * stride; i += stride) {
+                for (size_t j = i; j < i + block; j++) {
+                    screen_t screen(offset);
+                    for (size_t row = 0; row < crop_height; row++) {
+                        pixel_t *p = &pixels[(j * HEIGHT + crop_top + row) * WIDTH + crop_left];
+                        std::copy(p, p + crop_width, &screen[row * crop_width]);
+                    }
+                    screens.push_back(screen);
+                }
+            }
+        }
 
-        return trajectory_t(screens, trajectories);
+        return screens;
     }
 };
 
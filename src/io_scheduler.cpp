@@ -0,0 +1,96 @@
+#include <algorithm>
+
+#include "io_scheduler.hpp"
+
+IOScheduler::IOScheduler() : sequence(0), running(0), released(true) {
+    thread = std::thread(&IOScheduler::work, this);
+}
+
+IOScheduler &IOScheduler::instance() {
+    // Never destroyed, so that stores released while the process exits can
+    // still be closed
+    static IOScheduler *scheduler = new IOScheduler();
+    return *scheduler;
+}
+
+uint64_t IOScheduler::enqueue(std::function<void()> run, io_priority_t priority, clock::time_point deadline) {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t id = sequence++;
+    order_t order(priority, deadline, id);
+    task_t &task = tasks[id].second;
+    tasks[id].first = order;
+    task.run = run;
+    task.submitted = clock::now();
+    task.deadline = deadline;
+    queue.insert(order);
+    stats.queue_depth = queue.size();
+    stats.max_queue_depth = std::max(stats.max_queue_depth, stats.queue_depth);
+    wake.notify_one();
+    return id;
+}
+
+bool IOScheduler::promote(uint64_t ticket, io_priority_t priority) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<uint64_t, std::pair<order_t, task_t>>::iterator it = tasks.find(ticket);
+    if (it == tasks.end()) {
+        return false;
+    }
+    order_t &order = it->second.first;
+    if (std::get<0>(order) > priority) {
+        queue.erase(order);
+        std::get<0>(order) = priority;
+        queue.insert(order);
+    }
+    return true;
+}
+
+void IOScheduler::barrier() {
+    if (std::this_thread::get_id() == thread.get_id()) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    uint64_t task = running;
+    release.wait(lock, [&]() { return released || running != task; });
+}
+
+io_scheduler_stats_t IOScheduler::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void IOScheduler::work() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        while (queue.empty()) {
+            wake.wait(lock);
+        }
+        order_t order = *queue.begin();
+        queue.erase(queue.begin());
+        std::map<uint64_t, std::pair<order_t, task_t>>::iterator it = tasks.find(std::get<2>(order));
+        task_t task = it->second.second;
+        tasks.erase(it);
+        stats.queue_depth = queue.size();
+        running = std::get<2>(order);
+        released = false;
+        lock.unlock();
+
+        clock::time_point started = clock::now();
+        task.run();
+        clock::time_point finished = clock::now();
+        // Let go of the task, and of the result it shares, for barrier()
+        task.run = std::function<void()>();
+
+        lock.lock();
+        released = true;
+        release.notify_all();
+        int priority = std::get<0>(order);
+        double wait = std::chrono::duration<double>(started - task.submitted).count();
+        stats.completed[priority]++;
+        stats.wait_seconds[priority] += wait;
+        stats.max_wait_seconds[priority] = std::max(stats.max_wait_seconds[priority], wait);
+        stats.busy_seconds += std::chrono::duration<double>(finished - started).count();
+        if (finished > task.deadline) {
+            stats.missed_deadlines++;
+        }
+    }
+}
@@ -0,0 +1,153 @@
+#ifndef ALE_ATARI_GRAND_CHALLENGE_IO_SCHEDULER_HPP
+#define ALE_ATARI_GRAND_CHALLENGE_IO_SCHEDULER_HPP
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <tuple>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+/* Lower values are served first */
+enum io_priority_t {
+    /* Someone is waiting for the result, e.g. a reset or a screen */
+    IO_PRIORITY_BLOCKING = 0,
+    /* Episodes that will probably be needed soon */
+    IO_PRIORITY_PREFETCH = 1,
+    IO_PRIORITIES = 2
+};
+
+struct io_scheduler_stats_t {
+    /* Tasks waiting to run, now and at most */
+    size_t queue_depth = 0;
+    size_t max_queue_depth = 0;
+    /* Tasks run, and the time they spent queued, per priority */
+    uint64_t completed[IO_PRIORITIES] = {0};
+    double wait_seconds[IO_PRIORITIES] = {0};
+    double max_wait_seconds[IO_PRIORITIES] = {0};
+    /* Time spent running tasks */
+    double busy_seconds = 0;
+    /* Tasks that finished after their deadline */
+    uint64_t missed_deadlines = 0;
+};
+
+/*
+ * The thread that makes every call into the trajectory stores of the process.
+ * Stores aren't thread-safe, and HDF5 serializes its calls anyway, so rather
+ * than having environments queue on a lock in whatever order they get there,
+ * they hand their reads to this thread, which runs them by priority (and,
+ * within a priority, earliest deadline first) and returns futures. An urgent
+ * read thus never waits behind more than the task being run.
+ *
+ * Deadlines only order the queue; tasks past their deadline still run, and
+ * are counted in the stats.
+ */
+class IOScheduler {
+public:
+    typedef std::chrono::steady_clock clock;
+
+private:
+    struct task_t {
+        std::function<void()> run;
+        clock::time_point submitted;
+        clock::time_point deadline;
+    };
+    /* Priority, deadline and sequence number */
+    typedef std::tuple<int, clock::time_point, uint64_t> order_t;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::set<order_t> queue;
+    /* Queued tasks, by sequence number (ticket) */
+    std::map<uint64_t, std::pair<order_t, task_t>> tasks;
+    uint64_t sequence;
+    /* The task being run, which the thread holds until `released` */
+    uint64_t running;
+    bool released;
+    std::condition_variable release;
+    io_scheduler_stats_t stats;
+    std::thread thread;
+
+    IOScheduler();
+    IOScheduler(const IOScheduler &);
+    IOScheduler &operator=(const IOScheduler &);
+
+    uint64_t enqueue(std::function<void()> run, io_priority_t priority, clock::time_point deadline);
+    void work();
+
+    /* The task is destroyed before its result is handed over, so that
+     * whatever it holds is released on this thread and before anyone gets
+     * to wait for it */
+    template<typename T, typename F>
+    static void fulfil(std::promise<T> &promise, std::shared_ptr<F> &f) {
+        T value = (*f)();
+        f.reset();
+        promise.set_value(std::move(value));
+    }
+
+    template<typename F>
+    static void fulfil(std::promise<void> &promise, std::shared_ptr<F> &f) {
+        (*f)();
+        f.reset();
+        promise.set_value();
+    }
+
+public:
+    /* The scheduler of the process, started on first use */
+    static IOScheduler &instance();
+
+    /* Queues `f` and returns the future of its result. If `ticket` isn't
+     * NULL, it's set to a number that identifies the task for promote(). */
+    template<typename F>
+    std::future<decltype(std::declval<F>()())> submit(F f, io_priority_t priority = IO_PRIORITY_BLOCKING,
+            clock::time_point deadline = clock::time_point::max(), uint64_t *ticket = NULL) {
+        typedef decltype(std::declval<F>()()) result_t;
+        std::shared_ptr<std::promise<result_t>> promise(new std::promise<result_t>());
+        std::future<result_t> ret = promise->get_future();
+        std::shared_ptr<F> task(new F(f));
+        uint64_t id = enqueue([promise, task]() mutable {
+            try {
+                fulfil(*promise, task);
+            } catch (...) {
+                task.reset();
+                promise->set_exception(std::current_exception());
+            }
+        }, priority, deadline);
+        if (ticket != NULL) {
+            *ticket = id;
+        }
+        return ret;
+    }
+
+    /* Runs `f` on the scheduler as a blocking task and waits for it. Tasks
+     * that call this run `f` in place. */
+    template<typename F>
+    decltype(std::declval<F>()()) run(F f) {
+        if (std::this_thread::get_id() == thread.get_id()) {
+            return f();
+        }
+        return submit(f).get();
+    }
+
+    /* Returns once the scheduler has let go of the task it is running, if
+     * any. A task's result stays shared with the scheduler until then, even
+     * after its future is ready, so owners call this after waiting for their
+     * futures and before dropping them, for the last reference to what the
+     * tasks returned (and to the stores behind it) to go on their own
+     * thread. */
+    void barrier();
+
+    /* Raises the priority of a task that hasn't started yet. Returns whether
+     * it was still queued. */
+    bool promote(uint64_t ticket, io_priority_t priority);
+
+    io_scheduler_stats_t getStats();
+};
+
+#endif //ALE_ATARI_GRAND_CHALLENGE_IO_SCHEDULER_HPP
@@ -25,7 +25,7 @@ PhosphorBlend::PhosphorBlend() {
   makeAveragePalette();
 }
 
-void PhosphorBlend::process(ALEScreen& screen, const std::vector<pixel_t> &previous_buffer, const std::vector<pixel_t> &current_buffer) {
+void PhosphorBlend::process(ALEScreen& screen, const pixel_t *previous_buffer, const pixel_t *current_buffer) {
   // Process each pixel in turn
   for (size_t i = 0; i < screen.arraySize(); i++) {
     int cv = current_buffer[i];
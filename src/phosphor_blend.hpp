@@ -27,7 +27,7 @@ class PhosphorBlend {
   public:
     PhosphorBlend();
 
-    void process(ALEScreen& screen, const std::vector<pixel_t> &previous, const std::vector<pixel_t> &current);
+    void process(ALEScreen& screen, const pixel_t *previous, const pixel_t *current);
 
     void process(std::vector<pixel_t> &screen, const std::vector<pixel_t> &previous, const std::vector<pixel_t> &current);
 
@@ -0,0 +1,393 @@
+#ifndef ALE_ATARI_GRAND_CHALLENGE_TCP_STORE_HPP
+#define ALE_ATARI_GRAND_CHALLENGE_TCP_STORE_HPP
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "trajectory_store.hpp"
+#include "agcd_pack.hpp"
+
+/*
+ * Protocol between TCPStore and agcd-tcp-server. Every message is a uint32
+ * payload length, a uint8 type and the payload, all little-endian. Clients
+ * send one request at a time. The server answers each with a reply, except
+ * screen requests, which it answers with a stream of batches followed by an
+ * end message.
+ *
+ * Each batch holds up to the server's batch size of frames. For each frame
+ * it holds the encoding (uint8), data size (uint32) and data. The data is
+ * the (cropped) screen, raw or, with AGCD_TCP_DELTA, XORed with the previous
+ * frame of the stream and run-length encoded as in pack files. Frames come
+ * in the order they were asked for; their events are read separately, with
+ * AGCD_TCP_GET_EVENTS.
+ */
+enum agcd_tcp_message_t {
+    AGCD_TCP_LIST_GAMES = 1,
+    AGCD_TCP_LIST_TRAJECTORIES = 2,
+    AGCD_TCP_GET_EVENTS = 3,
+    AGCD_TCP_GET_SCREENS = 4,
+    AGCD_TCP_SET_RESOLUTION = 5,
+    AGCD_TCP_HAS_SCREENS = 6,
+    AGCD_TCP_REPLY = 64,
+    AGCD_TCP_BATCH = 65,
+    AGCD_TCP_END = 66,
+    AGCD_TCP_ERROR = 67
+};
+
+enum agcd_tcp_encoding_t {
+    AGCD_TCP_RAW = 0,
+    AGCD_TCP_DELTA = 1
+};
+
+static const uint32_t AGCD_TCP_MAX_MESSAGE = 1 << 30;
+
+template <typename T>
+static inline void agcd_tcp_encode(uint8_t *bytes, T value) {
+    uint64_t v = (uint64_t) value;
+    for (size_t i = 0; i < sizeof(T); i++) {
+        bytes[i] = (uint8_t) (v >> (8 * i));
+    }
+}
+
+template <typename T>
+static inline T agcd_tcp_decode(const uint8_t *bytes) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+        v |= (uint64_t) bytes[i] << (8 * i);
+    }
+    return (T) v;
+}
+
+/* Payload of a message, written and read front to back */
+class TCPMessage {
+private:
+    size_t offset = 0;
+
+public:
+    std::vector<uint8_t> data;
+
+    /* Integers are written little-endian, whatever the host */
+    template <typename T>
+    void put(T value) {
+        uint8_t bytes[sizeof(T)];
+        agcd_tcp_encode(bytes, value);
+        put_bytes(bytes, sizeof(T));
+    }
+
+    void put_bytes(const void *bytes, size_t size) {
+        const uint8_t *p = (const uint8_t *) bytes;
+        data.insert(data.end(), p, p + size);
+    }
+
+    void put_string(const std::string &s) {
+        put<uint32_t>(s.size());
+        put_bytes(s.data(), s.size());
+    }
+
+    const uint8_t *get_bytes(size_t size) {
+        if (size > data.size() - offset) {
+            throw std::runtime_error("Truncated message");
+        }
+        offset += size;
+        return &data[offset - size];
+    }
+
+    template <typename T>
+    T get() {
+        return agcd_tcp_decode<T>(get_bytes(sizeof(T)));
+    }
+
+    std::string get_string() {
+        uint32_t size = get<uint32_t>();
+        const char *s = (const char *) get_bytes(size);
+        return std::string(s, size);
+    }
+};
+
+static inline bool agcd_tcp_write(int fd, const void *buffer, size_t size) {
+    const uint8_t *p = (const uint8_t *) buffer;
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static inline bool agcd_tcp_read(int fd, void *buffer, size_t size) {
+    uint8_t *p = (uint8_t *) buffer;
+    while (size > 0) {
+        ssize_t n = recv(fd, p, size, 0);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static inline bool agcd_tcp_send(int fd, uint8_t type, const TCPMessage &message) {
+    uint8_t header[5];
+    uint32_t size = message.data.size();
+    agcd_tcp_encode(header, size);
+    header[4] = type;
+    return agcd_tcp_write(fd, header, sizeof(header)) &&
+        (size == 0 || agcd_tcp_write(fd, &message.data[0], size));
+}
+
+static inline bool agcd_tcp_receive(int fd, uint8_t &type, TCPMessage &message) {
+    uint8_t header[5];
+    if (!agcd_tcp_read(fd, header, sizeof(header))) {
+        return false;
+    }
+    uint32_t size = agcd_tcp_decode<uint32_t>(header);
+    type = header[4];
+    if (size > AGCD_TCP_MAX_MESSAGE) {
+        return false;
+    }
+    message = TCPMessage();
+    message.data.resize(size);
+    return size == 0 || agcd_tcp_read(fd, &message.data[0], size);
+}
+
+/* Lets small messages go out without waiting for more */
+static inline void agcd_tcp_set_options(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+/*
+ * Reads trajectories from an agcd-tcp-server, for learners on hosts other than
+ * the one holding the dataset. Screens are cropped by the server, so only the
+ * pixels asked for go over the network.
+ */
+class TCPStore : public TrajectoryStore {
+private:
+    TCPStore();
+    TCPStore(const TCPStore &);
+    int fd;
+    std::string address;
+    bool grayscale = false;
+
+    /* Frames read at once by episodes, as each read is a round trip */
+    static const hsize_t BATCH_FRAMES = 256;
+
+    void send(uint8_t type, const TCPMessage &message) {
+        if (!agcd_tcp_send(fd, type, message)) {
+            throw std::runtime_error("Connection to " + address + " lost");
+        }
+    }
+
+    /* Receives the next message, which has to be of the given type */
+    TCPMessage receive(uint8_t expected) {
+        uint8_t type;
+        TCPMessage message;
+        if (!agcd_tcp_receive(fd, type, message)) {
+            throw std::runtime_error("Connection to " + address + " lost");
+        }
+        if (type == AGCD_TCP_ERROR) {
+            throw std::runtime_error(address + ": " + message.get_string());
+        }
+        if (type != expected) {
+            throw std::runtime_error("Unexpected message from " + address);
+        }
+        return message;
+    }
+
+    TCPMessage request(uint8_t type, const TCPMessage &message) {
+        send(type, message);
+        return receive(AGCD_TCP_REPLY);
+    }
+
+public:
+    /* Connects to host:port */
+    TCPStore(const std::string &host, const std::string &port) : address(host + ":" + port) {
+        struct addrinfo hints, *addresses;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0) {
+            throw std::invalid_argument("Unable to resolve " + address);
+        }
+        fd = -1;
+        for (struct addrinfo *a = addresses; a != NULL && fd < 0; a = a->ai_next) {
+            fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) < 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(addresses);
+        if (fd < 0) {
+            throw std::invalid_argument("Unable to connect to " + address);
+        }
+        agcd_tcp_set_options(fd);
+    }
+
+    ~TCPStore() {
+        close(fd);
+    }
+
+    std::vector<std::string> get_games() {
+        TCPMessage reply = request(AGCD_TCP_LIST_GAMES, TCPMessage());
+        std::vector<std::string> games(reply.get<uint32_t>());
+        for (size_t i = 0; i < games.size(); i++) {
+            games[i] = reply.get_string();
+        }
+        return games;
+    }
+
+    game_vector_pair_t get_trajectories(std::string game) {
+        TCPMessage message;
+        message.put_string(game);
+        TCPMessage reply = request(AGCD_TCP_LIST_TRAJECTORIES, message);
+        game_vector_pair_t trajectories(reply.get<uint32_t>());
+        for (size_t i = 0; i < trajectories.size(); i++) {
+            trajectories[i].first = reply.get_string();
+            trajectories[i].second = reply.get<uint64_t>();
+        }
+        return trajectories;
+    }
+
+    /* Trajectories are all equally far away, so their order will do */
+    std::vector<haddr_t> get_trajectory_locations(std::string game) {
+        std::vector<haddr_t> ret(get_trajectories(game).size());
+        for (size_t i = 0; i < ret.size(); i++) {
+            ret[i] = i;
+        }
+        return ret;
+    }
+
+    agcd_events_t get_event_columns(std::string game, std::string trajectory_id, int columns,
+            hsize_t count = (hsize_t) -1) {
+        TCPMessage message;
+        message.put_string(game);
+        message.put_string(trajectory_id);
+        message.put<int32_t>(columns);
+        message.put<uint64_t>(count);
+        TCPMessage reply = request(AGCD_TCP_GET_EVENTS, message);
+
+        agcd_events_t events;
+        events.length = reply.get<uint64_t>();
+        if (columns & EVENT_FRAME) {
+            for (size_t i = 0; i < events.length; i++) {
+                events.frame.push_back(reply.get<int32_t>());
+            }
+        }
+        if (columns & EVENT_REWARD) {
+            for (size_t i = 0; i < events.length; i++) {
+                events.reward.push_back(reply.get<int32_t>());
+            }
+        }
+        if (columns & EVENT_SCORE) {
+            for (size_t i = 0; i < events.length; i++) {
+                events.score.push_back(reply.get<int32_t>());
+            }
+        }
+        if (columns & EVENT_TERMINAL) {
+            const uint8_t *terminal = reply.get_bytes(events.length);
+            events.terminal.assign(terminal, terminal + events.length);
+        }
+        if (columns & EVENT_ACTION) {
+            const int8_t *action = (const int8_t *) reply.get_bytes(events.length);
+            events.action.assign(action, action + events.length);
+        }
+        return events;
+    }
+
+    hsize_t get_chunk_frames(std::string, std::string) {
+        return BATCH_FRAMES;
+    }
+
+    std::vector<screen_t> get_screens(std::string game, std::string trajectory_id, hsize_t start, hsize_t count,
+            hsize_t stride = 1, hsize_t block = 1) {
+        TCPMessage message;
+        message.put_string(game);
+        message.put_string(trajectory_id);
+        hsize_t values[] = {start, count, stride, block, crop_top, crop_left, crop_height, crop_width};
+        for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+            message.put<uint64_t>(values[i]);
+        }
+        send(AGCD_TCP_GET_SCREENS, message);
+
+        std::vector<screen_t> screens;
+        const size_t size = crop_height * crop_width;
+        screen_t previous(size, 0);
+        while (true) {
+            uint8_t type;
+            TCPMessage batch;
+            if (!agcd_tcp_receive(fd, type, batch)) {
+                throw std::runtime_error("Connection to " + address + " lost");
+            }
+            if (type == AGCD_TCP_END) {
+                break;
+            }
+            if (type == AGCD_TCP_ERROR) {
+                throw std::runtime_error(address + ": " + batch.get_string());
+            }
+            if (type != AGCD_TCP_BATCH) {
+                throw std::runtime_error("Unexpected message from " + address);
+            }
+
+            uint32_t frames = batch.get<uint32_t>();
+            for (size_t i = 0; i < frames; i++) {
+                uint8_t encoding = batch.get<uint8_t>();
+                uint32_t data_size = batch.get<uint32_t>();
+                const uint8_t *data = batch.get_bytes(data_size);
+
+                screen_t screen(size);
+                if (encoding == AGCD_TCP_DELTA) {
+                    agcd_pack_rle_decode(data, data_size, &screen[0], size);
+                    for (size_t j = 0; j < size; j++) {
+                        screen[j] ^= previous[j];
+                    }
+                } else if (data_size == size) {
+                    memcpy(&screen[0], data, size);
+                } else {
+                    throw std::runtime_error("Unexpected message from " + address);
+                }
+                previous = screen;
+                screens.push_back(screen);
+            }
+        }
+        return screens;
+    }
+
+    void set_resolution(hsize_t height, hsize_t width) {
+        TCPMessage message;
+        message.put<uint64_t>(height);
+        message.put<uint64_t>(width);
+        TCPMessage reply = request(AGCD_TCP_SET_RESOLUTION, message);
+        grayscale = reply.get<uint8_t>();
+        screen_height = reply.get<uint64_t>();
+        screen_width = reply.get<uint64_t>();
+        set_crop(0, 0, screen_height, screen_width);
+    }
+
+    bool is_grayscale() const {
+        return grayscale;
+    }
+
+    bool has_screens(std::string game) {
+        TCPMessage message;
+        message.put_string(game);
+        return request(AGCD_TCP_HAS_SCREENS, message).get<uint8_t>();
+    }
+};
+
+#endif //ALE_ATARI_GRAND_CHALLENGE_TCP_STORE_HPP
@@ -0,0 +1,54 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "trajectory_store.hpp"
+#include "hdf5_wrapper.hpp"
+#include "agcd_pack.hpp"
+#include "tcp_store.hpp"
+
+TrajectoryStore *open_trajectory_store(const char *path) {
+    // Segments hold a raw pack, which is mapped read-only
+    if (strncmp(path, SHM_PREFIX, strlen(SHM_PREFIX)) == 0) {
+        std::string name = "/" + std::string(path + strlen(SHM_PREFIX));
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            throw std::invalid_argument("Unable to attach to shared memory segment " + name);
+        }
+        TrajectoryStore *store;
+        try {
+            store = new AGCDPack(fd);
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+        close(fd);
+        return store;
+    }
+
+    if (strncmp(path, TCP_PREFIX, strlen(TCP_PREFIX)) == 0) {
+        std::string address(path + strlen(TCP_PREFIX));
+        size_t colon = address.rfind(':');
+        if (colon == std::string::npos) {
+            throw std::invalid_argument("No port in " + std::string(path));
+        }
+        return new TCPStore(address.substr(0, colon), address.substr(colon + 1));
+    }
+
+    char magic[sizeof(AGCD_PACK_MAGIC)];
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        throw std::invalid_argument("Unable to open file");
+    }
+    size_t read = fread(magic, 1, sizeof(magic), fp);
+    fclose(fp);
+
+    if (read == sizeof(magic) && memcmp(magic, AGCD_PACK_MAGIC, sizeof(magic)) == 0) {
+        return new AGCDPack(path);
+    }
+    return new H5Wrapper(path);
+}
@@ -0,0 +1,236 @@
+#ifndef ALE_ATARI_GRAND_CHALLENGE_TRAJECTORY_STORE_HPP
+#define ALE_ATARI_GRAND_CHALLENGE_TRAJECTORY_STORE_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <cstdint>
+
+/* Offsets and sizes are HDF5's, whatever the backend */
+#include <hdf5.h>
+
+static const int WIDTH = 160;
+static const int HEIGHT = 210;
+
+struct agcd_trajectory_t {
+    int frame;
+    int reward;
+    int score;
+    int terminal;
+    int action;
+};
+
+/* Columns of the event table of a trajectory, in the order of
+ * agcd_trajectory_t */
+enum event_column_t {
+    EVENT_FRAME = 1 << 0,
+    EVENT_REWARD = 1 << 1,
+    EVENT_SCORE = 1 << 2,
+    EVENT_TERMINAL = 1 << 3,
+    EVENT_ACTION = 1 << 4,
+    EVENT_ALL = (1 << 5) - 1
+};
+
+/* The event table of a trajectory, stored by column. Only the columns that
+ * were asked for are filled. */
+struct agcd_events_t {
+    size_t length = 0;
+    std::vector<int> frame;
+    std::vector<int> reward;
+    std::vector<int> score;
+    std::vector<uint8_t> terminal;
+    std::vector<int8_t> action;
+
+    size_t size() const {
+        return length;
+    }
+};
+
+/* Event tables of the trajectories of a game, by trajectory id */
+typedef std::vector<std::pair<std::string, agcd_events_t>> game_events_t;
+
+/* What the episodes of a game can be selected and ordered by (see
+ * EpisodeQuery) */
+struct trajectory_summary_t {
+    std::string id;
+    size_t length;
+    /* Score at the last frame */
+    long long final_score;
+    long long total_reward;
+};
+
+typedef unsigned char pixel_t;
+typedef std::vector<pixel_t> screen_t;
+
+typedef std::pair<std::vector<screen_t>, std::vector<agcd_trajectory_t>> trajectory_t;
+
+typedef std::pair<std::string, size_t> game_pair_t;
+/* This is a vector of pairs of trajectory names and sizes */
+typedef std::vector<game_pair_t> game_vector_pair_t;
+/* This is what we keep in memory */
+typedef std::map<std::string, game_vector_pair_t> game_trajectory_t;
+
+/*
+ * Where trajectories are read from. H5Wrapper reads the HDF5 files written by
+ * agcd-to-hdf5, AGCDPack the flat pack files written by agcd-to-hdf5 -p.
+ * Screens are returned cropped as set by set_crop().
+ */
+class TrajectoryStore {
+protected:
+    /* Dimensions of the screens at the current resolution */
+    hsize_t screen_height = HEIGHT;
+    hsize_t screen_width = WIDTH;
+    /* Region of the screens that is read */
+    hsize_t crop_top = 0;
+    hsize_t crop_left = 0;
+    hsize_t crop_height = HEIGHT;
+    hsize_t crop_width = WIDTH;
+
+public:
+    virtual ~TrajectoryStore() {
+    }
+
+    virtual std::vector<std::string> get_games() = 0;
+
+    /* Trajectory ids and lengths of a game, sorted by id */
+    virtual game_vector_pair_t get_trajectories(std::string game) = 0;
+
+    /* Returns the file location of the screens of each trajectory of a game,
+     * in the same order as get_trajectories() */
+    virtual std::vector<haddr_t> get_trajectory_locations(std::string game) = 0;
+
+    /* Reads only the requested columns (a mask of event_column_t) of the
+     * events of a trajectory, stopping after `count` frames */
+    virtual agcd_events_t get_event_columns(std::string game, std::string trajectory_id, int columns,
+            hsize_t count = (hsize_t) -1) = 0;
+
+    /* Reads the requested columns of the events of every trajectory of a
+     * game, in the same order as get_trajectories(). Screens are never
+     * read. */
+    virtual game_events_t get_game_events(std::string game, int columns) {
+        game_events_t ret;
+        game_vector_pair_t trajectories = get_trajectories(game);
+        for (size_t i = 0; i < trajectories.size(); i++) {
+            ret.push_back(std::make_pair(
+                trajectories[i].first, get_event_columns(game, trajectories[i].first, columns)
+            ));
+        }
+        return ret;
+    }
+
+    /* Summarizes every trajectory of a game, in the same order as
+     * get_trajectories(), from its reward and score columns */
+    virtual std::vector<trajectory_summary_t> get_trajectory_summaries(std::string game) {
+        game_events_t events = get_game_events(game, EVENT_REWARD | EVENT_SCORE);
+        std::vector<trajectory_summary_t> ret(events.size());
+        for (size_t i = 0; i < events.size(); i++) {
+            const agcd_events_t &columns = events[i].second;
+            ret[i].id = events[i].first;
+            ret[i].length = columns.size();
+            ret[i].final_score = columns.score.empty() ? 0 : columns.score.back();
+            ret[i].total_reward = 0;
+            for (size_t j = 0; j < columns.reward.size(); j++) {
+                ret[i].total_reward += columns.reward[j];
+            }
+        }
+        return ret;
+    }
+
+    std::vector<agcd_trajectory_t> get_events(std::string game, std::string trajectory_id) {
+        agcd_events_t columns = get_event_columns(game, trajectory_id, EVENT_ALL);
+        if (columns.frame.size() != columns.size() || columns.reward.size() != columns.size() ||
+                columns.score.size() != columns.size() || columns.terminal.size() != columns.size() ||
+                columns.action.size() != columns.size()) {
+            throw std::runtime_error("Event columns of " + game + "/" + trajectory_id + " differ in length");
+        }
+        std::vector<agcd_trajectory_t> events(columns.size());
+        for (size_t i = 0; i < columns.size(); i++) {
+            events[i].frame = columns.frame[i];
+            events[i].reward = columns.reward[i];
+            events[i].score = columns.score[i];
+            events[i].terminal = columns.terminal[i];
+            events[i].action = columns.action[i];
+        }
+        return events;
+    }
+
+    /* Returns the smallest number of frames that have to be decoded to read
+     * any single frame of a trajectory */
+    virtual hsize_t get_chunk_frames(std::string game, std::string trajectory_id) = 0;
+
+    /* Reads `count` blocks of `block` consecutive screens of a trajectory,
+     * the first starting at frame `start` and each following one `stride`
+     * frames after the previous one. The default reads `count` consecutive
+     * screens. Blocks that run past the end of the trajectory are not
+     * returned. */
+    virtual std::vector<screen_t> get_screens(std::string game, std::string trajectory_id, hsize_t start, hsize_t count,
+            hsize_t stride = 1, hsize_t block = 1) = 0;
+
+    /* Returns the {frames, height, width} screens of a trajectory in place,
+     * mapped into memory, or NULL if they aren't stored in a way that can be
+     * mapped as read (uncompressed, contiguous and uncropped). The mapping
+     * lives as long as the store. */
+    virtual const pixel_t *map_screens(std::string, std::string, hsize_t &) {
+        return NULL;
+    }
+
+    /* Makes get_screens() read chunks with a ChunkReader, using `threads`
+     * inflate workers, where the store supports it */
+    virtual void set_raw_chunk_reads(bool, size_t = 0) {
+    }
+
+    trajectory_t get_trajectory(std::string game, std::string trajectory_id) {
+        std::vector<agcd_trajectory_t> trajectories = get_events(game, trajectory_id);
+        std::vector<screen_t> screens = get_screens(game, trajectory_id, 0, trajectories.size());
+        return trajectory_t(screens, trajectories);
+    }
+
+    /* Makes get_screens() read the grayscale screens downscaled to the given
+     * resolution, instead of the palette indices at full resolution. A
+     * resolution of 0x0 goes back to the latter. Resets the crop
+     * rectangle. */
+    virtual void set_resolution(hsize_t height, hsize_t width) = 0;
+
+    /* Whether screens are grayscale values rather than palette indices */
+    virtual bool is_grayscale() const = 0;
+
+    /* Whether the screens of a game are stored at the current resolution */
+    virtual bool has_screens(std::string game) = 0;
+
+    /* Restricts the screens read by get_screens() to the given rectangle */
+    void set_crop(hsize_t top, hsize_t left, hsize_t height, hsize_t width) {
+        if (height == 0 || width == 0 || top + height > screen_height || left + width > screen_width) {
+            throw std::invalid_argument("Crop rectangle out of the screen");
+        }
+        crop_top = top;
+        crop_left = left;
+        crop_height = height;
+        crop_width = width;
+    }
+
+    hsize_t get_screen_height() const {
+        return crop_height;
+    }
+
+    hsize_t get_screen_width() const {
+        return crop_width;
+    }
+
+    bool is_cropped() const {
+        return crop_top != 0 || crop_left != 0 || crop_height != screen_height || crop_width != screen_width;
+    }
+};
+
+/* Paths starting with this prefix name a POSIX shared memory segment, as
+ * served by agcd-shm-server, rather than a file */
+static const char SHM_PREFIX[] = "shm://";
+/* Paths starting with this prefix name an agcd-tcp-server, as host:port */
+static const char TCP_PREFIX[] = "tcp://";
+
+/* Opens the HDF5 or pack file at `path`, depending on its contents, or
+ * attaches to the shared memory segment or connects to the server it names */
+TrajectoryStore *open_trajectory_store(const char *path);
+
+#endif //ALE_ATARI_GRAND_CHALLENGE_TRAJECTORY_STORE_HPP
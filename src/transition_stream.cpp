@@ -0,0 +1,171 @@
+#include <algorithm>
+
+#include "transition_stream.hpp"
+
+TransitionStream::TransitionStream(const std::string &rom_file, const Settings &settings) :
+        claimed(0), consuming(0), stopping(false) {
+    std::string path;
+    split_rom_game_path(rom_file, path, game);
+    store = open_game_store(path, game, settings);
+    max_frames = std::max(settings.getInt("max_num_frames_per_episode"), 0);
+    frame_skip = std::max(settings.getInt("frame_skip"), 1);
+    color_averaging = settings.getBool("color_averaging") && !store->is_grayscale();
+    read_ahead = std::max(settings.getInt("chunk_read_ahead"), 1);
+    num_workers = std::max(settings.getInt("stream_workers"), 1);
+    slot_capacity = std::max<size_t>(std::max(settings.getInt("stream_buffer_size"), 0) / num_workers, 1);
+
+    EpisodeQuery query(settings.getString("episode_filter"), settings.getString("episode_order"));
+    std::vector<haddr_t> locations;
+    bool epochs = settings.getBool("epoch_processing");
+    game_vector_pair_t trajectories = IOScheduler::instance().run([&]() {
+        return select_trajectories(*store, game, query, epochs ? &locations : NULL);
+    });
+    if (epochs) {
+        unsigned int seed = settings.getInt("random_seed");
+        if (seed == 0) {
+            seed = std::random_device()();
+        }
+        EpisodeSampler sampler(trajectories, locations, settings.getInt("epoch_window"), seed);
+        for (size_t i = 0; i < sampler.size(); i++) {
+            order.push_back(sampler.next().first);
+        }
+    } else {
+        for (size_t i = 0; i < trajectories.size(); i++) {
+            order.push_back(trajectories[i].first);
+        }
+    }
+
+    for (size_t i = 0; i < num_workers; i++) {
+        workers.push_back(std::thread(&TransitionStream::work, this));
+    }
+}
+
+TransitionStream::~TransitionStream() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    consumed_cv.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+    IOScheduler::instance().barrier();
+}
+
+bool TransitionStream::next(Transition &transition) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (consuming < order.size()) {
+        std::map<size_t, slot_t>::iterator it = slots.find(consuming);
+        if (it != slots.end() && !it->second.transitions.empty()) {
+            transition = std::move(it->second.transitions.front());
+            it->second.transitions.pop_front();
+            consumed_cv.notify_all();
+            return true;
+        }
+        if (it != slots.end() && it->second.done) {
+            slots.erase(it);
+            consuming++;
+            consumed_cv.notify_all();
+            continue;
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        decoded_cv.wait(lock);
+    }
+    return false;
+}
+
+void TransitionStream::work() {
+    // Color averaging tables are large, so only built when needed
+    std::unique_ptr<PhosphorBlend> phosphor(color_averaging ? new PhosphorBlend() : NULL);
+    ALEScreen blended(getScreenHeight(), getScreenWidth());
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        // Workers stay within num_workers episodes of the consumer, so at
+        // most num_workers slots, of slot_capacity transitions each, fill up
+        consumed_cv.wait(lock, [this]() {
+            return stopping || claimed >= order.size() || claimed < consuming + num_workers;
+        });
+        if (stopping || claimed >= order.size()) {
+            return;
+        }
+        size_t position = claimed++;
+        slots[position];
+        lock.unlock();
+
+        try {
+            decode(position, phosphor.get(), blended);
+        } catch (...) {
+            lock.lock();
+            if (!error) {
+                error = std::current_exception();
+            }
+            stopping = true;
+            consumed_cv.notify_all();
+            decoded_cv.notify_all();
+            return;
+        }
+
+        lock.lock();
+        slots[position].done = true;
+        decoded_cv.notify_all();
+    }
+}
+
+void TransitionStream::decode(size_t position, PhosphorBlend *phosphor, ALEScreen &blended) {
+    io_priority_t priority;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        priority = position == consuming ? IO_PRIORITY_BLOCKING : IO_PRIORITY_PREFETCH;
+    }
+    std::shared_ptr<Episode> episode = EpisodeRegistry::instance().requestEpisode(
+        store, game, order[position], max_frames, frame_skip, color_averaging, read_ahead, priority
+    ).get();
+    if (episode->size() == 0) {
+        return;
+    }
+
+    size_t last = episode->size() - 1;
+    std::vector<pixel_t> carried;
+    for (size_t frame = 0; ; ) {
+        Transition transition;
+        transition.episode = episode;
+        transition.frame = frame;
+        transition.next_frame = std::min(frame + frame_skip, last);
+        transition.action = episode->getAction(frame);
+        transition.reward = episode->getRewardSum(frame, frame_skip);
+        transition.terminal = transition.next_frame == last;
+
+        // Screens are read here rather than by the consumer. The next
+        // observation is the observation of the next transition, so it is
+        // only blended once.
+        episode->getScreen(frame);
+        const pixel_t *next = episode->getScreen(transition.next_frame);
+        if (phosphor != NULL) {
+            transition.blended.swap(carried);
+            if (transition.next_frame > 0) {
+                phosphor->process(blended, episode->getScreen(transition.next_frame - 1), next);
+                transition.next_blended.assign(blended.getArray(), blended.getArray() + episode->getScreenSize());
+            }
+            carried = transition.next_blended;
+        }
+
+        bool terminal = transition.terminal;
+        frame = transition.next_frame;
+        std::unique_lock<std::mutex> lock(mutex);
+        slot_t &slot = slots[position];
+        consumed_cv.wait(lock, [&]() {
+            return stopping || slot.transitions.size() < slot_capacity;
+        });
+        if (stopping) {
+            return;
+        }
+        slot.transitions.push_back(std::move(transition));
+        decoded_cv.notify_one();
+        if (terminal) {
+            return;
+        }
+    }
+}
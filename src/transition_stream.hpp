@@ -0,0 +1,177 @@
+#ifndef ALE_ATARI_GRAND_CHALLENGE_TRANSITION_STREAM_HPP
+#define ALE_ATARI_GRAND_CHALLENGE_TRANSITION_STREAM_HPP
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <condition_variable>
+
+#include "ale_interface.hpp"
+
+/*
+ * A step of a trajectory: the observation at a frame, the action taken, the
+ * rewards collected over the next frame_skip frames, and the observation
+ * they lead to. Observations point into the episode, which the transition
+ * holds, unless they had to be color averaged.
+ */
+struct Transition {
+    std::shared_ptr<Episode> episode;
+    size_t frame;
+    size_t next_frame;
+    int action;
+    reward_t reward;
+    /* Whether next_frame is the last frame of the episode */
+    bool terminal;
+    /* Color averaged screens, if color_averaging is set */
+    std::vector<pixel_t> blended;
+    std::vector<pixel_t> next_blended;
+
+    const std::string &getTrajectory() const {
+        return episode->getId();
+    }
+
+    const pixel_t *getObservation() const {
+        return blended.empty() ? episode->getScreen(frame) : &blended[0];
+    }
+
+    const pixel_t *getNextObservation() const {
+        return next_blended.empty() ? episode->getScreen(next_frame) : &next_blended[0];
+    }
+
+    size_t getObservationSize() const {
+        return episode->getScreenSize();
+    }
+};
+
+/*
+ * Every transition of a game, in order, for offline pipelines that would
+ * otherwise drive an ALEInterface through each episode:
+ *
+ *     for (const Transition &t : TransitionStream("dataset.h5/revenge", settings))
+ *
+ * Episodes are visited once, in file order or, with epoch_processing, in the
+ * order of one EpisodeSampler epoch. stream_workers threads read and decode
+ * the episodes ahead of the consumer, each working on its own episode, and
+ * stop when stream_buffer_size transitions are waiting, until the consumer
+ * catches up. Store reads still go through the IOScheduler; the workers
+ * overlap them with the consumer and with each other's color averaging.
+ *
+ * Other settings are those of ALEInterface: frame_skip, color_averaging,
+ * max_num_frames_per_episode, chunk_read_ahead, random_seed, the episode
+ * query (episode_filter and episode_order, whose order replaces file order)
+ * and the store settings.
+ */
+class TransitionStream {
+public:
+    class iterator {
+    public:
+        explicit iterator(TransitionStream *stream = NULL) : stream(stream) {
+            ++*this;
+        }
+
+        const Transition &operator*() const {
+            return stream->current;
+        }
+
+        const Transition *operator->() const {
+            return &stream->current;
+        }
+
+        iterator &operator++() {
+            if (stream != NULL && !stream->next(stream->current)) {
+                stream = NULL;
+            }
+            return *this;
+        }
+
+        bool operator==(const iterator &other) const {
+            return stream == other.stream;
+        }
+
+        bool operator!=(const iterator &other) const {
+            return stream != other.stream;
+        }
+
+    private:
+        TransitionStream *stream;
+    };
+
+    TransitionStream(const std::string &rom_file, const Settings &settings);
+    ~TransitionStream();
+
+    /* Moves the next transition into `transition`, waiting for it to be
+     * decoded. Returns false once every episode has been streamed. Errors
+     * of the workers are rethrown here. */
+    bool next(Transition &transition);
+
+    /* Single pass: begin() starts from where the stream is */
+    iterator begin() {
+        return iterator(this);
+    }
+
+    iterator end() {
+        return iterator();
+    }
+
+    /* Number of episodes streamed */
+    size_t size() const {
+        return order.size();
+    }
+
+    size_t getScreenHeight() const {
+        return store->get_screen_height();
+    }
+
+    size_t getScreenWidth() const {
+        return store->get_screen_width();
+    }
+
+private:
+    /* The transitions of an episode, as decoded */
+    struct slot_t {
+        std::deque<Transition> transitions;
+        bool done = false;
+    };
+
+    TransitionStream(const TransitionStream &);
+    TransitionStream &operator=(const TransitionStream &);
+
+    std::shared_ptr<TrajectoryStore> store;
+    std::string game;
+    /* Trajectory ids, in the order they are streamed */
+    std::vector<std::string> order;
+    size_t max_frames;
+    size_t frame_skip;
+    bool color_averaging;
+    size_t read_ahead;
+    size_t num_workers;
+    /* Transitions buffered per episode */
+    size_t slot_capacity;
+
+    std::mutex mutex;
+    /* Signals workers that an episode or a transition was consumed */
+    std::condition_variable consumed_cv;
+    /* Signals the consumer that a transition was decoded */
+    std::condition_variable decoded_cv;
+    /* Episodes being decoded or waiting to be consumed, by position in
+     * `order` */
+    std::map<size_t, slot_t> slots;
+    /* Position of the next episode a worker takes, and of the one being
+     * consumed */
+    size_t claimed;
+    size_t consuming;
+    bool stopping;
+    std::exception_ptr error;
+    std::vector<std::thread> workers;
+    Transition current;
+
+    void work();
+    void decode(size_t position, PhosphorBlend *phosphor, ALEScreen &blended);
+};
+
+#endif //ALE_ATARI_GRAND_CHALLENGE_TRANSITION_STREAM_HPP
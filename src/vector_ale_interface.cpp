@@ -0,0 +1,185 @@
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include "vector_ale_interface.hpp"
+
+VectorALEInterface::VectorALEInterface(size_t num_envs) :
+        theSettings(new Settings), cursors(num_envs), blended(HEIGHT, WIDTH) {
+    if (num_envs == 0) {
+        throw std::invalid_argument("No environments");
+    }
+}
+
+VectorALEInterface::~VectorALEInterface() {
+    cursors.clear();
+    if (episodeCache != NULL) {
+        delete episodeCache;
+    }
+    if (episodeSampler != NULL) {
+        delete episodeSampler;
+    }
+}
+
+int VectorALEInterface::getInt(const std::string& key) {
+    return theSettings->getInt(key);
+}
+
+bool VectorALEInterface::getBool(const std::string& key) {
+    return theSettings->getBool(key);
+}
+
+float VectorALEInterface::getFloat(const std::string& key) {
+    return theSettings->getFloat(key);
+}
+
+std::string VectorALEInterface::getString(const std::string& key) {
+    return theSettings->getString(key);
+}
+
+void VectorALEInterface::setInt(const std::string& key, const int value) {
+    theSettings->setInt(key, value);
+}
+
+void VectorALEInterface::setBool(const std::string& key, const bool value) {
+    theSettings->setBool(key, value);
+}
+
+void VectorALEInterface::setFloat(const std::string& key, const float value) {
+    theSettings->setFloat(key, value);
+}
+
+void VectorALEInterface::setString(const std::string& key, const std::string& value) {
+    theSettings->setString(key, value);
+}
+
+void VectorALEInterface::loadROM(std::string rom_file) {
+    loaded = false;
+    for (size_t i = 0; i < cursors.size(); i++) {
+        cursors[i] = cursor_t();
+    }
+    if (episodeCache != NULL) {
+        delete episodeCache;
+        episodeCache = NULL;
+    }
+    if (episodeSampler != NULL) {
+        delete episodeSampler;
+        episodeSampler = NULL;
+    }
+
+    theSettings->validate();
+    start_frame_min = theSettings->getHandle("start_frame_min");
+    start_frame_max = theSettings->getHandle("start_frame_max");
+
+    std::string path, game;
+    split_rom_game_path(rom_file, path, game);
+    store = open_game_store(path, game, *theSettings);
+    color_averaging = getBool("color_averaging") && !store->is_grayscale();
+    blended = ALEScreen(store->get_screen_height(), store->get_screen_width());
+
+    // Every environment has an episode in play and another one prefetched
+    episodeCache = new EpisodeCache(
+        store, game, std::max<size_t>(std::max(getInt("episode_cache_size"), 0), cursors.size()),
+        std::max(getInt("max_num_frames_per_episode"), 0),
+        EpisodeQuery(getString("episode_filter"), getString("episode_order"))
+    );
+    frame_skip = std::max(getInt("frame_skip"), 1);
+    episodeCache->setStride(frame_skip, color_averaging);
+    episodeCache->setReadAhead(std::max(getInt("chunk_read_ahead"), 1));
+
+    unsigned int seed = getInt("random_seed");
+    if (seed == 0) {
+        seed = std::random_device()();
+    }
+    rng.seed(seed);
+    if (getBool("epoch_processing")) {
+        episodeSampler = new EpisodeSampler(
+            episodeCache->getTrajectories(), episodeCache->getTrajectoryLocations(), getInt("epoch_window"), seed
+        );
+    } else if (episodeCache->getTrajectories().empty()) {
+        throw std::invalid_argument("No trajectories for " + game);
+    }
+
+    for (size_t i = 0; i < cursors.size(); i++) {
+        pickNext(cursors[i]);
+    }
+    for (size_t i = 0; i < cursors.size(); i++) {
+        resetCursor(cursors[i]);
+    }
+    loaded = true;
+}
+
+void VectorALEInterface::pickNext(cursor_t &cursor) {
+    if (episodeSampler != NULL) {
+        cursor.next = episodeSampler->next().first;
+    } else {
+        const game_vector_pair_t &trajectories = episodeCache->getTrajectories();
+        std::uniform_int_distribution<size_t> dis(0, trajectories.size() - 1);
+        cursor.next = trajectories[dis(rng)].first;
+    }
+    episodeCache->prefetch(cursor.next);
+}
+
+void VectorALEInterface::resetCursor(cursor_t &cursor) {
+    cursor.episode = episodeCache->get(cursor.next);
+    cursor.frame = 0;
+    int first = theSettings->getInt(start_frame_min);
+    int last = theSettings->getInt(start_frame_max);
+    if (first != 0 || last != 0) {
+        size_t a = episode_frame(first, cursor.episode->size());
+        size_t b = episode_frame(last, cursor.episode->size());
+        std::uniform_int_distribution<size_t> dis(std::min(a, b), std::max(a, b));
+        cursor.frame = dis(rng);
+    }
+    pickNext(cursor);
+}
+
+void VectorALEInterface::observe(cursor_t &cursor, pixel_t *observation) {
+    const pixel_t *current = cursor.episode->getScreen(cursor.frame);
+    if (color_averaging && cursor.frame > 0) {
+        phosphor.process(blended, cursor.episode->getScreen(cursor.frame - 1), current);
+        current = blended.getArray();
+    }
+    memcpy(observation, current, cursor.episode->getScreenSize());
+}
+
+void VectorALEInterface::reset(pixel_t *observations) {
+    size_t size = getObservationSize();
+    for (size_t i = 0; i < cursors.size(); i++) {
+        resetCursor(cursors[i]);
+        observe(cursors[i], observations + i * size);
+    }
+}
+
+void VectorALEInterface::step(const int *, pixel_t *observations, reward_t *rewards, uint8_t *dones) {
+    size_t size = getObservationSize();
+    for (size_t i = 0; i < cursors.size(); i++) {
+        cursor_t &cursor = cursors[i];
+        size_t last = cursor.episode->size() - 1;
+        rewards[i] = cursor.episode->getRewardSum(cursor.frame, frame_skip);
+        cursor.frame = std::min(cursor.frame + frame_skip, last);
+        dones[i] = cursor.frame == last;
+        if (dones[i]) {
+            resetCursor(cursor);
+        }
+        observe(cursor, observations + i * size);
+    }
+}
+
+void VectorALEInterface::getActions(int *actions) {
+    for (size_t i = 0; i < cursors.size(); i++) {
+        actions[i] = cursors[i].episode->getAction(cursors[i].frame);
+    }
+}
+
+size_t VectorALEInterface::getScreenHeight() const {
+    return store ? store->get_screen_height() : HEIGHT;
+}
+
+size_t VectorALEInterface::getScreenWidth() const {
+    return store ? store->get_screen_width() : WIDTH;
+}
+
+int VectorALEInterface::getEpoch() const {
+    return episodeSampler != NULL ? episodeSampler->getEpoch() : 0;
+}
@@ -0,0 +1,109 @@
+#ifndef ALE_ATARI_GRAND_CHALLENGE_VECTOR_ALE_INTERFACE_HPP
+#define ALE_ATARI_GRAND_CHALLENGE_VECTOR_ALE_INTERFACE_HPP
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "ale_interface.hpp"
+
+/**
+   N environments replaying trajectories of the same game, stepped together.
+   Each environment is a cursor into an episode; step() advances them all and
+   writes their observations into a single [N, height, width] buffer, with no
+   AtariState or screen copy in between. An environment whose episode ends is
+   reset right away into the episode picked for it in advance, which has been
+   read in the background meanwhile.
+
+   Settings are those of ALEInterface. Episodes are picked at random, or, with
+   epoch_processing, from an epoch shared by all the environments. Observations
+   are the stored screens: palette indices (colour averaged if asked for) or,
+   at a downscaled resolution, grayscale values.
+ */
+class VectorALEInterface {
+public:
+    explicit VectorALEInterface(size_t num_envs);
+    ~VectorALEInterface();
+
+    // Get or set the value of a setting, as for ALEInterface. loadROM() must
+    // be called before the setting will take effect.
+    int getInt(const std::string& key);
+    bool getBool(const std::string& key);
+    float getFloat(const std::string& key);
+    std::string getString(const std::string& key);
+    void setInt(const std::string& key, const int value);
+    void setBool(const std::string& key, const bool value);
+    void setFloat(const std::string& key, const float value);
+    void setString(const std::string& key, const std::string& value);
+
+    // Loads a game, as ALEInterface::loadROM(), and resets every environment
+    void loadROM(std::string rom_file);
+
+    // Whether loadROM() has loaded a game. The environments can only be
+    // reset, stepped or asked for their actions once it has.
+    bool isLoaded() const { return loaded; }
+
+    // Resets every environment into a new episode, and writes their
+    // observations
+    void reset(pixel_t *observations);
+
+    // Steps every environment frame_skip frames. Actions are ignored, since
+    // the recorded ones are replayed as by ALEInterface::act(), and may be
+    // NULL; the parameter is kept for compatibility with the ALE. Writes the N
+    // observations, the rewards and whether each episode ended, in which case
+    // the environment has already been reset and the observation is the
+    // first of its new episode.
+    void step(const int *actions, pixel_t *observations, reward_t *rewards, uint8_t *dones);
+
+    // Writes the action taken in each environment's current frame
+    void getActions(int *actions);
+
+    // Number of environments
+    size_t size() const {
+        return cursors.size();
+    }
+
+    // Dimensions of an observation, after cropping
+    size_t getScreenHeight() const;
+    size_t getScreenWidth() const;
+
+    size_t getObservationSize() const {
+        return getScreenHeight() * getScreenWidth();
+    }
+
+    // The current epoch, with epoch_processing
+    int getEpoch() const;
+
+private:
+    struct cursor_t {
+        std::shared_ptr<Episode> episode;
+        size_t frame;
+        // Trajectory the environment resets into next, being prefetched
+        std::string next;
+    };
+
+    std::unique_ptr<Settings> theSettings;
+    std::vector<cursor_t> cursors;
+    std::shared_ptr<TrajectoryStore> store;
+    EpisodeCache *episodeCache = NULL;
+    EpisodeSampler *episodeSampler = NULL;
+    PhosphorBlend phosphor;
+    ALEScreen blended;
+    std::mt19937 rng;
+    size_t frame_skip = 1;
+    bool color_averaging = false;
+    Settings::Handle start_frame_min;
+    Settings::Handle start_frame_max;
+    // Set once loadROM() has reset every environment
+    bool loaded = false;
+
+    // Picks the episode an environment resets into next, and prefetches it
+    void pickNext(cursor_t &cursor);
+    // Moves an environment into the episode picked for it
+    void resetCursor(cursor_t &cursor);
+    void observe(cursor_t &cursor, pixel_t *observation);
+};
+
+#endif //ALE_ATARI_GRAND_CHALLENGE_VECTOR_ALE_INTERFACE_HPP
@@ -0,0 +1,658 @@
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <iostream>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include <hdf5.h>
+
+#include "../src/hdf5_wrapper.hpp"
+#include "../src/episode_query.hpp"
+#include "hdf5_writer.hpp"
+
+/*
+ * Rewrites an AGCD HDF5 file with another chunk shape or compression level,
+ * and optionally only a subset of its trajectories, in another order (see
+ * EpisodeQuery).
+ *
+ * HDF5 isn't thread-safe, so every call into it holds hdf5_mutex. Workers
+ * read the stored chunks of a trajectory under it, then inflate, rechunk and
+ * deflate them on their own, one chunk at a time, and the main thread writes
+ * the compressed chunks as they are with H5Dwrite_chunk(), in order. Chunks
+ * whose layout and level don't change are copied without being decoded.
+ */
+
+static std::mutex hdf5_mutex;
+
+/* Frames copied at once into contiguous datasets */
+static const hsize_t COPY_FRAMES = 64;
+
+struct repack_options_t {
+    /* Frames per chunk of the screens, or 0 to keep the layout of each
+     * dataset */
+    hsize_t chunk_frames = 0;
+    /* Store screens contiguous and uncompressed */
+    bool contiguous = false;
+    /* Deflate level of chunked screens, 0 for none, or -1 to keep the level
+     * of each dataset */
+    int level = -1;
+    std::vector<std::string> games;
+    std::string filter;
+    std::string order;
+    size_t jobs = 0;
+};
+
+/* A chunk of screens as stored in the file: deflated, unless the deflate
+ * filter is skipped (filter_mask is 1) or the dataset has no filter */
+struct stored_chunk_t {
+    std::vector<uint8_t> data;
+    uint32_t filter_mask;
+};
+
+/* Where the screens of a dataset are read from, a range of frames at a time.
+ * Chunks of whole frames that are deflated, or not filtered at all, are
+ * read as stored, and inflated one at a time without holding the HDF5 lock.
+ * Other datasets are read through HDF5, except for legacy ones, which are a
+ * single chunk and are read whole. */
+struct source_screens_t {
+    enum mode_t { STORED, HYPERSLAB, WHOLE };
+    mode_t mode = WHOLE;
+    /* {frames, height, width} */
+    hsize_t dims[3] = {0, 0, 0};
+    /* Frames per chunk, or 0 if contiguous */
+    hsize_t chunk_frames = 0;
+    bool deflate = false;
+    /* Deflate level of the chunks, 0 if unfiltered, -1 if not known */
+    int level = -1;
+    hid_t dataset_id = -1;
+    std::vector<stored_chunk_t> stored;
+    /* Every frame with WHOLE, the chunk `decoded` with STORED */
+    std::vector<uint8_t> frames;
+    size_t decoded = (size_t) -1;
+};
+
+/* The screens of a trajectory in one screen group, encoded for the output */
+struct repacked_screens_t {
+    hsize_t dims[3];
+    bool contiguous;
+    hsize_t chunk_frames;
+    int level;
+    std::vector<stored_chunk_t> chunks;
+    /* What contiguous datasets are copied from, as they are written */
+    source_screens_t source;
+};
+
+struct repacked_trajectory_t {
+    std::string id;
+    bool ok;
+    /* One per screen group of the game */
+    std::vector<repacked_screens_t> screens;
+    std::vector<agcd_trajectory_t> events;
+};
+
+void usage(char *name) {
+    printf("usage: %s [-c chunk_frames | -u] [-z level] [-g game]... [-f filter] [-o order] [-j jobs]\n", name);
+    printf("       /path/to/in.h5 /path/to/out.h5\n");
+    printf("\n");
+    printf("  -c chunk_frames  number of frames per compressed chunk (default: as in the\n");
+    printf("                   input)\n");
+    printf("  -u               store screens contiguous and uncompressed\n");
+    printf("  -z level         deflate level of the chunks, 0 to not compress them\n");
+    printf("                   (default: as in the input, or 3)\n");
+    printf("  -g game          only copy this game (default: all of them)\n");
+    printf("  -f filter        only copy the trajectories matching this episode filter\n");
+    printf("                   (e.g., \"score>=p80\")\n");
+    printf("  -o order         write the trajectories sorted by this field (e.g.,\n");
+    printf("                   \"-score\"), renumbered from 1 in that order\n");
+    printf("  -j jobs          number of trajectories processed in parallel (default:\n");
+    printf("                   one per core)\n");
+}
+
+/* Parses a decimal integer from `min` to `max`, with nothing after it */
+static bool parse_integer(const char *s, long min, long max, long &value) {
+    char *end;
+    errno = 0;
+    value = strtol(s, &end, 10);
+    return end != s && *end == '\0' && errno == 0 && value >= min && value <= max;
+}
+
+/* Names of the screen groups of a game, "screens" and "screens_HxW_gray" */
+static std::vector<std::string> screen_groups(hid_t file_id, const std::string &game,
+        std::vector<resolution_t> &downscaled) {
+    std::vector<std::string> ret;
+    hid_t group_id = H5Gopen(file_id, ("/" + game).c_str(), H5P_DEFAULT);
+    H5G_info_t info;
+    if (group_id < 0 || H5Gget_info(group_id, &info) < 0) {
+        return ret;
+    }
+    for (hsize_t i = 0; i < info.nlinks; i++) {
+        char name[256];
+        if (H5Lget_name_by_idx(group_id, ".", H5_INDEX_NAME, H5_ITER_INC, i, name, sizeof(name), H5P_DEFAULT) < 0) {
+            continue;
+        }
+        unsigned int height, width;
+        char suffix[8];
+        if (strcmp(name, "screens") == 0) {
+            ret.insert(ret.begin(), name);
+        } else if (sscanf(name, "screens_%ux%u_%7s", &height, &width, suffix) == 3 && strcmp(suffix, "gray") == 0 &&
+                resolution_group(resolution_t(height, width)) == name) {
+            ret.push_back(name);
+            downscaled.push_back(resolution_t(height, width));
+        }
+    }
+    H5Gclose(group_id);
+    return ret;
+}
+
+/* Opens the screens of a dataset for reading. Stored chunks, or every frame
+ * of a legacy dataset, are read right away. */
+static bool open_source(hid_t file_id, const std::string &path, source_screens_t &source) {
+    std::lock_guard<std::mutex> lock(hdf5_mutex);
+    hid_t dataset_id = H5Dopen(file_id, path.c_str(), H5P_DEFAULT);
+    if (dataset_id < 0) {
+        return false;
+    }
+    hid_t space_id = H5Dget_space(dataset_id);
+    hid_t plist_id = H5Dget_create_plist(dataset_id);
+    hid_t type_id = H5Dget_type(dataset_id);
+    hsize_t chunk[3] = {0, 0, 0};
+    bool ok = H5Sget_simple_extent_ndims(space_id) == 3 && H5Sget_simple_extent_dims(space_id, source.dims, NULL) == 3;
+    bool chunked = ok && H5Pget_layout(plist_id) == H5D_CHUNKED && H5Pget_chunk(plist_id, 3, chunk) == 3;
+    bool stored = chunked && H5Tget_size(type_id) == 1 && chunk[0] > 0 &&
+        chunk[1] == source.dims[1] && chunk[2] == source.dims[2];
+    int filters = H5Pget_nfilters(plist_id);
+    source.chunk_frames = chunked ? chunk[0] : 0;
+    source.level = chunked && filters == 0 ? 0 : -1;
+    if (chunked && filters == 1) {
+        unsigned flags, config, level = 0;
+        size_t values = 1;
+        source.deflate = H5Pget_filter2(plist_id, 0, &flags, &values, &level, 0, NULL, &config) == H5Z_FILTER_DEFLATE;
+        source.level = source.deflate && values > 0 ? level : -1;
+        stored = stored && source.deflate;
+    } else if (filters != 0) {
+        stored = false;
+    }
+
+    if (ok && source.dims[0] == HEIGHT && source.dims[1] == WIDTH &&
+            !(source.dims[1] == HEIGHT && source.dims[2] == WIDTH)) {
+        // Legacy files declare {HEIGHT, WIDTH, frames}, but store frames
+        // contiguously in a single chunk, so reading everything gives them
+        // frame-major
+        hsize_t frames = source.dims[2];
+        source.dims[0] = frames;
+        source.dims[1] = HEIGHT;
+        source.dims[2] = WIDTH;
+        source.mode = source_screens_t::WHOLE;
+        source.chunk_frames = 1;
+        source.level = -1;
+        source.frames.resize(frames * HEIGHT * WIDTH);
+        ok = frames == 0 ||
+            H5Dread(dataset_id, H5T_NATIVE_UCHAR, H5S_ALL, H5S_ALL, H5P_DEFAULT, &source.frames[0]) >= 0;
+    } else if (ok && stored) {
+        source.mode = source_screens_t::STORED;
+        for (hsize_t frame = 0; frame < source.dims[0] && ok; frame += chunk[0]) {
+            hsize_t offset[3] = {frame, 0, 0};
+            hsize_t bytes = 0;
+            stored_chunk_t c = {std::vector<uint8_t>(), 0};
+            if (H5Dget_chunk_storage_size(dataset_id, offset, &bytes) < 0) {
+                ok = false;
+            } else if (bytes > 0) {
+                c.data.resize(bytes);
+                ok = H5Dread_chunk(dataset_id, H5P_DEFAULT, offset, &c.filter_mask, &c.data[0]) >= 0;
+            }
+            source.stored.push_back(c);
+        }
+    } else if (ok) {
+        source.mode = source_screens_t::HYPERSLAB;
+        source.dataset_id = dataset_id;
+    }
+
+    H5Tclose(type_id);
+    H5Pclose(plist_id);
+    H5Sclose(space_id);
+    if (source.dataset_id != dataset_id) {
+        H5Dclose(dataset_id);
+    }
+    return ok;
+}
+
+static void close_source(source_screens_t &source) {
+    if (source.dataset_id >= 0) {
+        std::lock_guard<std::mutex> lock(hdf5_mutex);
+        H5Dclose(source.dataset_id);
+        source.dataset_id = -1;
+    }
+    std::vector<stored_chunk_t>().swap(source.stored);
+    std::vector<uint8_t>().swap(source.frames);
+}
+
+/* Reads `count` frames of a source from `first` on into `out` */
+static bool read_frames(source_screens_t &source, hsize_t first, hsize_t count, uint8_t *out) {
+    const size_t frame_size = source.dims[1] * source.dims[2];
+    if (source.mode == source_screens_t::WHOLE) {
+        std::copy(&source.frames[first * frame_size], &source.frames[(first + count) * frame_size], out);
+        return true;
+    }
+
+    if (source.mode == source_screens_t::HYPERSLAB) {
+        std::lock_guard<std::mutex> lock(hdf5_mutex);
+        hid_t space_id = H5Dget_space(source.dataset_id);
+        hsize_t offset[3] = {first, 0, 0};
+        hsize_t dims[3] = {count, source.dims[1], source.dims[2]};
+        hid_t memspace_id = H5Screate_simple(3, dims, NULL);
+        bool ok = H5Sselect_hyperslab(space_id, H5S_SELECT_SET, offset, NULL, dims, NULL) >= 0 &&
+            H5Dread(source.dataset_id, H5T_NATIVE_UCHAR, memspace_id, space_id, H5P_DEFAULT, out) >= 0;
+        H5Sclose(memspace_id);
+        H5Sclose(space_id);
+        return ok;
+    }
+
+    // Chunks never written are all zeros, HDF5's fill value
+    const size_t chunk_size = source.chunk_frames * frame_size;
+    while (count > 0) {
+        size_t i = first / source.chunk_frames;
+        if (source.decoded != i) {
+            const std::vector<uint8_t> &data = source.stored[i].data;
+            source.frames.resize(chunk_size);
+            if (data.empty()) {
+                std::fill(source.frames.begin(), source.frames.end(), 0);
+            } else if (source.deflate && !(source.stored[i].filter_mask & 1)) {
+                uLongf length = chunk_size;
+                if (uncompress(&source.frames[0], &length, &data[0], data.size()) != Z_OK || length != chunk_size) {
+                    return false;
+                }
+            } else if (data.size() == chunk_size) {
+                std::copy(data.begin(), data.end(), source.frames.begin());
+            } else {
+                return false;
+            }
+            source.decoded = i;
+        }
+        hsize_t offset = first - i * source.chunk_frames;
+        hsize_t n = std::min(count, source.chunk_frames - offset);
+        std::copy(&source.frames[offset * frame_size], &source.frames[(offset + n) * frame_size], out);
+        out += n * frame_size;
+        first += n;
+        count -= n;
+    }
+    return true;
+}
+
+/* Cuts the screens of a source into chunks of the output, padded to the full
+ * chunk size, and deflates them, a chunk at a time. Chunks deflate doesn't
+ * make smaller are stored as they are, skipping the filter, which readers
+ * handle. Chunks that keep their size and level are taken as stored.
+ * Contiguous output keeps the source, to be copied as it's written. */
+static bool encode_screens(repacked_screens_t &screens, const repack_options_t &options) {
+    source_screens_t &source = screens.source;
+    std::copy(source.dims, source.dims + 3, screens.dims);
+    screens.contiguous = options.contiguous || (source.chunk_frames == 0 && options.chunk_frames == 0);
+    if (screens.contiguous) {
+        screens.chunk_frames = 0;
+        screens.level = 0;
+        return true;
+    }
+    screens.chunk_frames = options.chunk_frames > 0 ? options.chunk_frames : source.chunk_frames;
+    screens.chunk_frames = std::max<hsize_t>(std::min(screens.chunk_frames, screens.dims[0]), 1);
+    screens.level = options.level >= 0 ? options.level : source.level >= 0 ? source.level : 3;
+
+    if (source.mode == source_screens_t::STORED && screens.chunk_frames == source.chunk_frames &&
+            screens.level == source.level && (screens.level > 0) == source.deflate) {
+        screens.chunks.swap(source.stored);
+        close_source(source);
+        return true;
+    }
+
+    const size_t chunk_size = screens.chunk_frames * screens.dims[1] * screens.dims[2];
+    std::vector<uint8_t> padded(chunk_size);
+    bool ok = true;
+    for (hsize_t first = 0; first < screens.dims[0] && ok; first += screens.chunk_frames) {
+        hsize_t count = std::min(screens.chunk_frames, screens.dims[0] - first);
+        ok = read_frames(source, first, count, &padded[0]);
+        std::fill(padded.begin() + count * screens.dims[1] * screens.dims[2], padded.end(), 0);
+
+        stored_chunk_t c = {std::vector<uint8_t>(), 0};
+        if (screens.level > 0) {
+            uLongf bound = compressBound(chunk_size);
+            c.data.resize(bound);
+            if (compress2(&c.data[0], &bound, &padded[0], chunk_size, screens.level) == Z_OK && bound < chunk_size) {
+                c.data.resize(bound);
+            } else {
+                c.data = padded;
+                c.filter_mask = 1;
+            }
+        } else {
+            c.data = padded;
+        }
+        screens.chunks.push_back(c);
+    }
+    close_source(source);
+    return ok;
+}
+
+/* Reads and re-encodes the screens, in every group, and events of a
+ * trajectory */
+static repacked_trajectory_t *repack_trajectory(H5Wrapper &store, hid_t file_id, const std::string &game,
+        const std::string &id, const std::vector<std::string> &groups, const repack_options_t &options) {
+    repacked_trajectory_t *trajectory = new repacked_trajectory_t();
+    trajectory->id = id;
+    trajectory->ok = true;
+    try {
+        agcd_events_t events;
+        {
+            std::lock_guard<std::mutex> lock(hdf5_mutex);
+            events = store.get_event_columns(game, id, EVENT_ALL);
+        }
+        if (events.frame.size() != events.size() || events.reward.size() != events.size() ||
+                events.score.size() != events.size() || events.terminal.size() != events.size() ||
+                events.action.size() != events.size()) {
+            throw std::runtime_error("incomplete events");
+        }
+        for (size_t i = 0; i < events.size(); i++) {
+            agcd_trajectory_t event = {events.frame[i], events.reward[i], events.score[i], events.terminal[i], events.action[i]};
+            trajectory->events.push_back(event);
+        }
+
+        trajectory->screens.resize(groups.size());
+        for (size_t i = 0; i < groups.size() && trajectory->ok; i++) {
+            repacked_screens_t &screens = trajectory->screens[i];
+            trajectory->ok = open_source(file_id, "/" + game + "/" + groups[i] + "/" + id, screens.source) &&
+                screens.source.dims[0] == events.size() && encode_screens(screens, options);
+            if (!trajectory->ok) {
+                std::cerr << "Failed to read " << groups[i] << " dataset for trajectory " << id << std::endl;
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Failed to read trajectory " << id << ": " << e.what() << std::endl;
+        trajectory->ok = false;
+    }
+    if (!trajectory->ok) {
+        for (size_t i = 0; i < trajectory->screens.size(); i++) {
+            close_source(trajectory->screens[i].source);
+        }
+    }
+    return trajectory;
+}
+
+/* Copies the screens of a contiguous dataset from their source, a few frames
+ * at a time */
+static herr_t copy_screens(hid_t dataset_id, repacked_screens_t &screens) {
+    const size_t frame_size = screens.dims[1] * screens.dims[2];
+    std::vector<uint8_t> frames(COPY_FRAMES * frame_size);
+    herr_t status = 0;
+    for (hsize_t first = 0; first < screens.dims[0] && status >= 0; first += COPY_FRAMES) {
+        hsize_t count = std::min(COPY_FRAMES, screens.dims[0] - first);
+        if (!read_frames(screens.source, first, count, &frames[0])) {
+            return -1;
+        }
+        std::lock_guard<std::mutex> lock(hdf5_mutex);
+        hid_t space_id = H5Dget_space(dataset_id);
+        hsize_t offset[3] = {first, 0, 0};
+        hsize_t dims[3] = {count, screens.dims[1], screens.dims[2]};
+        hid_t memspace_id = H5Screate_simple(3, dims, NULL);
+        status = H5Sselect_hyperslab(space_id, H5S_SELECT_SET, offset, NULL, dims, NULL);
+        if (status >= 0) {
+            status = H5Dwrite(dataset_id, H5T_NATIVE_UCHAR, memspace_id, space_id, H5P_DEFAULT, &frames[0]);
+        }
+        H5Sclose(memspace_id);
+        H5Sclose(space_id);
+    }
+    return status;
+}
+
+/* Writes a repacked trajectory under the id given */
+static int write_trajectory(repacked_trajectory_t &trajectory, const std::string &id,
+        const std::vector<hid_t> &group_ids, hid_t event_group) {
+    int ret = 0;
+    for (size_t i = 0; i < group_ids.size(); i++) {
+        repacked_screens_t &screens = trajectory.screens[i];
+        hsize_t chunk[3] = {screens.chunk_frames, screens.dims[1], screens.dims[2]};
+        hid_t dataset_id = -1;
+        herr_t status;
+        {
+            std::lock_guard<std::mutex> lock(hdf5_mutex);
+            status = write_dataset(group_ids[i], id.c_str(), 3, screens.dims, H5T_NATIVE_UCHAR, NULL, chunk,
+                                   screens.contiguous, screens.level);
+            if (status >= 0) {
+                dataset_id = H5Dopen(group_ids[i], id.c_str(), H5P_DEFAULT);
+            }
+            for (size_t j = 0; j < screens.chunks.size() && status >= 0; j++) {
+                hsize_t offset[3] = {j * screens.chunk_frames, 0, 0};
+                const stored_chunk_t &c = screens.chunks[j];
+                if (!c.data.empty()) {
+                    status = H5Dwrite_chunk(dataset_id, H5P_DEFAULT, c.filter_mask, offset, c.data.size(), &c.data[0]);
+                }
+            }
+        }
+        if (status >= 0 && dataset_id >= 0 && screens.contiguous) {
+            status = copy_screens(dataset_id, screens);
+        }
+        close_source(screens.source);
+        {
+            std::lock_guard<std::mutex> lock(hdf5_mutex);
+            if (dataset_id < 0 || H5Dclose(dataset_id) < 0) {
+                status = -1;
+            }
+        }
+        if (status < 0) {
+            std::cerr << "Failed to write screen dataset for trajectory " << id << std::endl;
+            ret = 1;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(hdf5_mutex);
+    if (write_events(event_group, id.c_str(), trajectory.events) < 0) {
+        std::cerr << "Failed to write event dataset for trajectory " << id << std::endl;
+        ret = 1;
+    }
+    return ret;
+}
+
+/* Copies the trajectories of a game the options select. Workers repack at
+ * most `jobs` trajectories ahead of the one being written, so that memory
+ * stays bounded however large the game is. */
+static int repack_game(H5Wrapper &store, hid_t in_id, hid_t out_id, const std::string &game,
+        const repack_options_t &options) {
+    std::vector<std::string> games = store.get_games();
+    if (std::find(games.begin(), games.end(), game) == games.end()) {
+        std::cerr << "No game " << game << " in the input. Skipping..." << std::endl;
+        return 1;
+    }
+
+    std::vector<resolution_t> downscaled;
+    std::vector<std::string> groups = screen_groups(in_id, game, downscaled);
+    game_vector_pair_t trajectories;
+    try {
+        trajectories = select_trajectories(store, game, EpisodeQuery(options.filter, options.order));
+    } catch (const std::invalid_argument &e) {
+        std::cerr << "Skipping " << game << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    hid_t group_id = H5Gcreate(out_id, ("/" + game).c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t event_id = H5Gcreate(group_id, "trajectories", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    std::vector<hid_t> group_ids;
+    for (size_t i = 0; i < groups.size(); i++) {
+        group_ids.push_back(H5Gcreate(group_id, groups[i].c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<repacked_trajectory_t *> repacked(trajectories.size(), NULL);
+    size_t claimed = 0, writing = 0;
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < std::min(options.jobs, trajectories.size()); i++) {
+        workers.push_back(std::thread([&]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                cv.wait(lock, [&]() {
+                    return claimed >= trajectories.size() || claimed < writing + options.jobs;
+                });
+                if (claimed >= trajectories.size()) {
+                    return;
+                }
+                size_t position = claimed++;
+                lock.unlock();
+                repacked_trajectory_t *trajectory = repack_trajectory(
+                    store, in_id, game, trajectories[position].first, groups, options
+                );
+                lock.lock();
+                repacked[position] = trajectory;
+                cv.notify_all();
+            }
+        }));
+    }
+
+    // Ids are renumbered in the new order, as readers sort trajectories by id
+    int ret = 0;
+    game_vector_pair_t written;
+    for (size_t i = 0; i < trajectories.size(); i++) {
+        repacked_trajectory_t *trajectory;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() { return repacked[i] != NULL; });
+            trajectory = repacked[i];
+            repacked[i] = NULL;
+            writing = i + 1;
+            cv.notify_all();
+        }
+
+        if (trajectory->ok) {
+            std::string id = options.order.empty() ? trajectory->id : std::to_string(written.size() + 1);
+            if (write_trajectory(*trajectory, id, group_ids, event_id) == 0) {
+                written.push_back(game_pair_t(id, trajectory->events.size()));
+            } else {
+                ret = 1;
+            }
+        } else {
+            ret = 1;
+        }
+        delete trajectory;
+    }
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+
+    ret |= create_global_index(group_id, game, written, downscaled);
+
+    for (size_t i = 0; i < group_ids.size(); i++) {
+        H5Gclose(group_ids[i]);
+    }
+    H5Gclose(event_id);
+    H5Gclose(group_id);
+    return ret;
+}
+
+int main(int argc, char *argv[]) {
+    repack_options_t options;
+    int opt;
+    long value;
+    while ((opt = getopt(argc, argv, "c:uz:g:f:o:j:")) != -1) {
+        switch (opt) {
+            case 'c':
+                if (!parse_integer(optarg, 1, LONG_MAX, value)) {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                options.chunk_frames = value;
+                break;
+            case 'u':
+                options.contiguous = true;
+                break;
+            case 'z':
+                if (!parse_integer(optarg, 0, 9, value)) {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                options.level = value;
+                break;
+            case 'g':
+                options.games.push_back(optarg);
+                break;
+            case 'f':
+                options.filter = optarg;
+                break;
+            case 'o':
+                options.order = optarg;
+                break;
+            case 'j':
+                if (!parse_integer(optarg, 1, LONG_MAX, value)) {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                options.jobs = value;
+                break;
+            default:
+                usage(argv[0]);
+                exit(1);
+        }
+    }
+    if (argc - optind != 2 || (options.contiguous && options.chunk_frames > 0)) {
+        usage(argv[0]);
+        exit(1);
+    }
+    if (options.jobs == 0) {
+        options.jobs = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    const char *in_file = argv[optind];
+    const char *out_file = argv[optind + 1];
+
+    // Malformed queries are reported before anything is written
+    try {
+        EpisodeQuery(options.filter, options.order);
+    } catch (const std::invalid_argument &e) {
+        fprintf(stderr, "%s\n", e.what());
+        exit(1);
+    }
+
+    H5Wrapper *store;
+    try {
+        store = new H5Wrapper(in_file);
+    } catch (const std::invalid_argument &) {
+        printf("Unable to open %s. Aborting.\n", in_file);
+        exit(1);
+    }
+    if (options.games.empty()) {
+        options.games = store->get_games();
+    }
+
+    if (access(out_file, F_OK) == 0) {
+        printf("Will not overwrite existing file %s. Aborting.\n", out_file);
+        exit(1);
+    }
+    hid_t in_id = H5Fopen(in_file, H5F_ACC_RDONLY, H5P_DEFAULT);
+    hid_t out_id = H5Fcreate(out_file, H5F_ACC_EXCL, H5P_DEFAULT, H5P_DEFAULT);
+    if (out_id < 0) {
+        printf("Unable to create %s. Aborting.\n", out_file);
+        exit(1);
+    }
+
+    int ret = 0;
+    if (H5Lexists(in_id, "palette", H5P_DEFAULT) > 0 &&
+            H5Ocopy(in_id, "palette", out_id, "palette", H5P_DEFAULT, H5P_DEFAULT) < 0) {
+        std::cerr << "Failed to copy the palette" << std::endl;
+        ret = 1;
+    }
+    for (size_t i = 0; i < options.games.size(); i++) {
+        ret |= repack_game(*store, in_id, out_id, options.games[i], options);
+    }
+
+    H5Fclose(out_id);
+    H5Fclose(in_id);
+    delete store;
+
+    return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
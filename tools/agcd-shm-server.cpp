@@ -0,0 +1,206 @@
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "../src/trajectory_store.hpp"
+#include "../src/agcd_pack.hpp"
+
+/*
+ * Decodes the episodes of an HDF5 (or pack) file once, into a POSIX shared
+ * memory segment laid out as a raw AGCD pack, and keeps it alive until
+ * interrupted. Actors on the same node attach to it read-only by loading
+ * shm://name/game, and then read screens in place.
+ */
+
+static volatile sig_atomic_t stopping = 0;
+/* Name of the segment being written, removed if it can't be finished */
+static std::string segment;
+
+static void stop(int) {
+    stopping = 1;
+}
+
+static void fail(const char *message) {
+    perror(message);
+    shm_unlink(segment.c_str());
+    exit(1);
+}
+
+void usage(char *name) {
+    printf("usage: %s [-n name] [-g game]... /path/to/agcd.h5\n", name);
+    printf("\n");
+    printf("  -n name  name of the shared memory segment (default: agcd). Actors load\n");
+    printf("           shm://name/game\n");
+    printf("  -g game  only serve this game (default: all of them)\n");
+}
+
+static uint64_t append_aligned(FILE *fp, const void *data, size_t size, size_t alignment) {
+    uint64_t offset = ftello(fp);
+    static const char zeros[4096] = {0};
+    if (offset % alignment) {
+        size_t padding = alignment - offset % alignment;
+        fwrite(zeros, 1, padding, fp);
+        offset += padding;
+    }
+    if (size > 0 && fwrite(data, 1, size, fp) != size) {
+        fail("Failed to write shared memory segment");
+    }
+    return offset;
+}
+
+/* Decodes a trajectory and appends it to the segment */
+static bool append_trajectory(FILE *fp, TrajectoryStore &store, const std::string &game, const std::string &id,
+        agcd_pack_trajectory_t &entry) {
+    memset(&entry, 0, sizeof(entry));
+    if (id.size() >= sizeof(entry.id)) {
+        fprintf(stderr, "Trajectory id %s is too long. Skipping...\n", id.c_str());
+        return false;
+    }
+
+    agcd_events_t events = store.get_event_columns(
+        game, id, EVENT_REWARD | EVENT_SCORE | EVENT_ACTION | EVENT_TERMINAL
+    );
+    std::vector<screen_t> screens = store.get_screens(game, id, 0, events.size());
+    size_t frames = std::min(events.size(), screens.size());
+    if (frames == 0 || events.reward.size() != events.size() || events.score.size() != events.size() ||
+            events.action.size() != events.size() || events.terminal.size() != events.size()) {
+        fprintf(stderr, "Unable to read trajectory %s. Skipping...\n", id.c_str());
+        return false;
+    }
+
+    memcpy(entry.id, id.data(), id.size());
+    entry.frames = frames;
+    entry.height = HEIGHT;
+    entry.width = WIDTH;
+    entry.compression = AGCD_PACK_RAW;
+
+    std::vector<uint8_t> columns(10 * frames);
+    for (size_t i = 0; i < frames; i++) {
+        int32_t reward = events.reward[i], score = events.score[i];
+        memcpy(&columns[4 * i], &reward, 4);
+        memcpy(&columns[4 * (frames + i)], &score, 4);
+        columns[8 * frames + i] = events.action[i];
+        columns[9 * frames + i] = events.terminal[i];
+    }
+    entry.events_offset = append_aligned(fp, &columns[0], columns.size(), 8);
+
+    const size_t frame_size = HEIGHT * WIDTH;
+    entry.screens_offset = append_aligned(fp, &screens[0][0], frame_size, 4096);
+    for (size_t i = 1; i < frames; i++) {
+        append_aligned(fp, &screens[i][0], frame_size, 1);
+    }
+    entry.screens_size = frames * frame_size;
+
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    std::string name = "agcd";
+    std::vector<std::string> games;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:g:")) != -1) {
+        switch (opt) {
+            case 'n':
+                name = optarg;
+                break;
+            case 'g':
+                games.push_back(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                exit(1);
+        }
+    }
+    if (argc - optind != 1 || name.empty() || name.find('/') != std::string::npos) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    TrajectoryStore *store = open_trajectory_store(argv[optind]);
+    if (games.empty()) {
+        games = store->get_games();
+    }
+
+    // Installed before the segment exists, so that it is removed if the
+    // build is interrupted
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    // Actors still attached to a previous segment keep it until they detach
+    segment = "/" + name;
+    shm_unlink(segment.c_str());
+    int fd = shm_open(segment.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    FILE *fp = fd < 0 ? NULL : fdopen(fd, "wb");
+    if (fp == NULL) {
+        fail("Failed to create shared memory segment");
+    }
+
+    // The header goes in last, so actors attaching early see no pack at all
+    agcd_pack_header_t header;
+    memset(&header, 0, sizeof(header));
+    append_aligned(fp, &header, sizeof(header), 1);
+
+    std::vector<agcd_pack_game_t> game_table;
+    size_t trajectories = 0;
+    for (size_t i = 0; i < games.size() && !stopping; i++) {
+        agcd_pack_game_t game;
+        memset(&game, 0, sizeof(game));
+        if (games[i].size() >= sizeof(game.name)) {
+            fprintf(stderr, "Game name %s is too long. Skipping...\n", games[i].c_str());
+            continue;
+        }
+        memcpy(game.name, games[i].data(), games[i].size());
+
+        game_vector_pair_t ids = store->get_trajectories(games[i]);
+        std::vector<agcd_pack_trajectory_t> entries;
+        for (size_t j = 0; j < ids.size() && !stopping; j++) {
+            agcd_pack_trajectory_t entry;
+            if (append_trajectory(fp, *store, games[i], ids[j].first, entry)) {
+                entries.push_back(entry);
+            }
+        }
+        game.num_trajectories = entries.size();
+        game.trajectories_offset = append_aligned(
+            fp, entries.empty() ? NULL : &entries[0], entries.size() * sizeof(agcd_pack_trajectory_t), 8
+        );
+        game_table.push_back(game);
+        trajectories += entries.size();
+    }
+    delete store;
+    if (stopping) {
+        fprintf(stderr, "Interrupted. Removing %s%s\n", SHM_PREFIX, name.c_str());
+        fclose(fp);
+        shm_unlink(segment.c_str());
+        exit(1);
+    }
+
+    memcpy(header.magic, AGCD_PACK_MAGIC, sizeof(header.magic));
+    header.version = AGCD_PACK_VERSION;
+    header.num_games = game_table.size();
+    header.games_offset = append_aligned(
+        fp, game_table.empty() ? NULL : &game_table[0], game_table.size() * sizeof(agcd_pack_game_t), 8
+    );
+    uint64_t size = ftello(fp);
+    if (fseeko(fp, 0, SEEK_SET) < 0 || fwrite(&header, sizeof(header), 1, fp) != 1 || fflush(fp) != 0) {
+        fail("Failed to write shared memory segment");
+    }
+
+    printf("Serving %zu trajectories (%.1f MB) at %s%s\n", trajectories, size / 1e6, SHM_PREFIX, name.c_str());
+    fflush(stdout);
+
+    while (!stopping) {
+        pause();
+    }
+
+    fclose(fp);
+    shm_unlink(segment.c_str());
+    return EXIT_SUCCESS;
+}
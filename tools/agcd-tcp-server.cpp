@@ -0,0 +1,261 @@
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <cstdint>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "../src/trajectory_store.hpp"
+#include "../src/tcp_store.hpp"
+
+/*
+ * Serves the trajectories of an HDF5 (or pack) file to TCPStore clients, i.e.
+ * to learners that load tcp://host:port/game. Each connection is served by a
+ * process of its own, with its own store.
+ */
+
+struct server_options_t {
+    uint16_t port = 9000;
+    /* Frames per batch of screens */
+    uint32_t batch_frames = 64;
+    /* Delta-encode frames against the previous one */
+    bool delta = false;
+};
+
+void usage(char *name) {
+    printf("usage: %s [-p port] [-b batch_frames] [-d] /path/to/agcd.h5\n", name);
+    printf("\n");
+    printf("  -p port          port to listen on (default: 9000)\n");
+    printf("  -b batch_frames  number of frames per batch (default: 64)\n");
+    printf("  -d               delta-encode frames against the previous one, where\n");
+    printf("                   it makes them smaller\n");
+}
+
+/* Appends a frame to a batch, delta-encoded against `previous` if asked for
+ * and if it helps */
+static void append_frame(TCPMessage &batch, const screen_t &screen, screen_t &previous, bool delta) {
+    std::vector<uint8_t> encoded;
+    if (delta) {
+        screen_t difference(screen.size());
+        for (size_t i = 0; i < screen.size(); i++) {
+            difference[i] = screen[i] ^ previous[i];
+        }
+        agcd_pack_rle_encode(&difference[0], difference.size(), encoded);
+    }
+    if (delta && encoded.size() < screen.size()) {
+        batch.put<uint8_t>(AGCD_TCP_DELTA);
+        batch.put<uint32_t>(encoded.size());
+        batch.put_bytes(&encoded[0], encoded.size());
+    } else {
+        batch.put<uint8_t>(AGCD_TCP_RAW);
+        batch.put<uint32_t>(screen.size());
+        batch.put_bytes(&screen[0], screen.size());
+    }
+    previous = screen;
+}
+
+/* Streams the screens asked for in batches */
+static bool send_screens(int fd, TrajectoryStore &store, TCPMessage &request, const server_options_t &options) {
+    std::string game = request.get_string();
+    std::string id = request.get_string();
+    uint64_t start = request.get<uint64_t>();
+    uint64_t count = request.get<uint64_t>();
+    uint64_t stride = request.get<uint64_t>();
+    uint64_t block = request.get<uint64_t>();
+    uint64_t top = request.get<uint64_t>();
+    uint64_t left = request.get<uint64_t>();
+    uint64_t height = request.get<uint64_t>();
+    uint64_t width = request.get<uint64_t>();
+    store.set_crop(top, left, height, width);
+
+    if (stride <= 1) {
+        count *= block;
+        stride = block = 1;
+    } else if (block > stride) {
+        throw std::invalid_argument("Blocks of screens cannot overlap");
+    }
+
+    // Screens are read a batch at a time, so the server never holds a whole
+    // trajectory
+    screen_t previous(height * width, 0);
+    uint64_t groups = std::max<uint64_t>(options.batch_frames / block, 1);
+    for (uint64_t i = 0; i < count; i += groups) {
+        uint64_t first = start + i * stride;
+        uint64_t asked = std::min(groups, count - i);
+        std::vector<screen_t> screens = store.get_screens(game, id, first, asked, stride, block);
+
+        TCPMessage batch;
+        batch.put<uint32_t>(screens.size());
+        for (size_t j = 0; j < screens.size(); j++) {
+            append_frame(batch, screens[j], previous, options.delta);
+        }
+        if (!screens.empty() && !agcd_tcp_send(fd, AGCD_TCP_BATCH, batch)) {
+            return false;
+        }
+        if (screens.size() < asked * block) {
+            break;
+        }
+    }
+    return agcd_tcp_send(fd, AGCD_TCP_END, TCPMessage());
+}
+
+/* Answers a request. Returns false if the connection is lost. */
+static bool serve_request(int fd, TrajectoryStore &store, uint8_t type, TCPMessage &request,
+        const server_options_t &options) {
+    TCPMessage reply;
+    if (type == AGCD_TCP_LIST_GAMES) {
+        std::vector<std::string> games = store.get_games();
+        reply.put<uint32_t>(games.size());
+        for (size_t i = 0; i < games.size(); i++) {
+            reply.put_string(games[i]);
+        }
+    } else if (type == AGCD_TCP_LIST_TRAJECTORIES) {
+        game_vector_pair_t trajectories = store.get_trajectories(request.get_string());
+        reply.put<uint32_t>(trajectories.size());
+        for (size_t i = 0; i < trajectories.size(); i++) {
+            reply.put_string(trajectories[i].first);
+            reply.put<uint64_t>(trajectories[i].second);
+        }
+    } else if (type == AGCD_TCP_GET_EVENTS) {
+        std::string game = request.get_string();
+        std::string id = request.get_string();
+        int columns = request.get<int32_t>();
+        uint64_t count = request.get<uint64_t>();
+        agcd_events_t events = store.get_event_columns(game, id, columns, count);
+        reply.put<uint64_t>(events.size());
+        const std::vector<int> *ints[] = {&events.frame, &events.reward, &events.score};
+        const int int_columns[] = {EVENT_FRAME, EVENT_REWARD, EVENT_SCORE};
+        for (size_t i = 0; i < 3; i++) {
+            if (columns & int_columns[i]) {
+                if (ints[i]->size() != events.size()) {
+                    throw std::runtime_error("Unable to read events of trajectory " + id);
+                }
+                for (size_t j = 0; j < events.size(); j++) {
+                    reply.put<int32_t>((*ints[i])[j]);
+                }
+            }
+        }
+        if (columns & EVENT_TERMINAL) {
+            if (events.terminal.size() != events.size()) {
+                throw std::runtime_error("Unable to read events of trajectory " + id);
+            }
+            reply.put_bytes(events.terminal.data(), events.size());
+        }
+        if (columns & EVENT_ACTION) {
+            if (events.action.size() != events.size()) {
+                throw std::runtime_error("Unable to read events of trajectory " + id);
+            }
+            reply.put_bytes(events.action.data(), events.size());
+        }
+    } else if (type == AGCD_TCP_GET_SCREENS) {
+        return send_screens(fd, store, request, options);
+    } else if (type == AGCD_TCP_SET_RESOLUTION) {
+        uint64_t height = request.get<uint64_t>();
+        uint64_t width = request.get<uint64_t>();
+        store.set_resolution(height, width);
+        reply.put<uint8_t>(store.is_grayscale());
+        reply.put<uint64_t>(store.get_screen_height());
+        reply.put<uint64_t>(store.get_screen_width());
+    } else if (type == AGCD_TCP_HAS_SCREENS) {
+        reply.put<uint8_t>(store.has_screens(request.get_string()));
+    } else {
+        throw std::invalid_argument("Unknown request");
+    }
+    return agcd_tcp_send(fd, AGCD_TCP_REPLY, reply);
+}
+
+static void serve(int fd, const char *path, const server_options_t &options) {
+    TrajectoryStore *store = open_trajectory_store(path);
+    while (true) {
+        uint8_t type;
+        TCPMessage request;
+        if (!agcd_tcp_receive(fd, type, request)) {
+            break;
+        }
+        bool connected;
+        try {
+            connected = serve_request(fd, *store, type, request, options);
+        } catch (std::exception &e) {
+            TCPMessage error;
+            error.put_string(e.what());
+            connected = agcd_tcp_send(fd, AGCD_TCP_ERROR, error);
+        }
+        if (!connected) {
+            break;
+        }
+    }
+    delete store;
+}
+
+int main(int argc, char *argv[]) {
+    server_options_t options;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:b:d")) != -1) {
+        switch (opt) {
+            case 'p':
+                options.port = atoi(optarg);
+                break;
+            case 'b':
+                options.batch_frames = atoi(optarg);
+                if (options.batch_frames < 1) {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'd':
+                options.delta = true;
+                break;
+            default:
+                usage(argv[0]);
+                exit(1);
+        }
+    }
+    if (argc - optind != 1) {
+        usage(argv[0]);
+        exit(1);
+    }
+    const char *path = argv[optind];
+
+    // Fail early if the file can't be served at all
+    delete open_trajectory_store(path);
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(options.port);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *) &address, sizeof(address)) < 0 ||
+            listen(listen_fd, 64) < 0) {
+        perror("Failed to listen");
+        exit(1);
+    }
+    printf("Serving %s on port %d\n", path, options.port);
+    fflush(stdout);
+
+    // Children are reaped automatically
+    signal(SIGCHLD, SIG_IGN);
+    while (true) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        agcd_tcp_set_options(fd);
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(listen_fd);
+            serve(fd, path, options);
+            close(fd);
+            _exit(0);
+        }
+        close(fd);
+    }
+}
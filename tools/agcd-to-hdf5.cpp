@@ -8,6 +8,7 @@
 #include <cassert>
 #include <cstring>
 #include <cmath>
+#include <cstdint>
 #include <algorithm>
 #include <sys/stat.h>
 
@@ -20,13 +21,12 @@
 #include <hdf5.h>
 #include <hdf5_hl.h>
 
-static const int WIDTH = 160;
-static const int HEIGHT = 210;
+#include "../src/agcd_pack.hpp"
+#include "hdf5_writer.hpp"
+
 static const char *DELIMITER = ", \n";
 static const int MAX_PATH_LENGTH = 2048;
 
-typedef unsigned char pixel_t;
-
 typedef struct {
     int width, height;
     png_byte color_type;
@@ -42,6 +42,18 @@ struct agcd_frame_t {
     int action;
 };
 
+struct converter_options_t {
+    /* Number of frames stored in each chunk of a screen dataset */
+    hsize_t chunk_frames = 1;
+    /* Store screens contiguous and uncompressed, so readers can map them */
+    bool contiguous = false;
+    /* Extra grayscale resolutions to store the screens at */
+    std::vector<resolution_t> resolutions;
+    /* Write an AGCD pack file instead of an HDF5 one */
+    bool pack = false;
+    agcd_pack_compression_t pack_compression = AGCD_PACK_RAW;
+};
+
 static const pixel_t NTSC_palette[] = { /* {{{ */
 	(pixel_t)0, (pixel_t)0, (pixel_t)0,
 	(pixel_t)0, (pixel_t)0, (pixel_t)0,
@@ -939,7 +951,87 @@ inline void load_screen(std::string path, pixel_t screen[]) {
 }
 
 void usage(char *name) {
-    printf("usage: %s /path/to/root /path/to/hdf5.h5\n", name);
+    printf("usage: %s [-c chunk_frames | -u] [-r HxW]... [-p raw|rle] /path/to/root /path/to/hdf5.h5\n", name);
+    printf("\n");
+    printf("  -c chunk_frames  number of frames per compressed chunk (default: 1)\n");
+    printf("  -u               store screens contiguous and uncompressed, so that they\n");
+    printf("                   can be memory-mapped when read\n");
+    printf("  -r HxW           also store grayscale screens downscaled to H rows and W\n");
+    printf("                   columns, in screens_HxW_gray (e.g., -r 84x84)\n");
+    printf("  -p raw|rle       write an AGCD pack file, with raw or run-length encoded\n");
+    printf("                   screens, instead of an HDF5 file. -c and -r don't apply\n");
+}
+
+/* Luminance of each palette entry, computed as the ALE does */
+static inline std::vector<float> palette_luminance() {
+    std::vector<float> ret(256);
+    for (size_t i = 0; i < 256; i++) {
+        const pixel_t *rgb = &NTSC_palette[3 * i];
+        ret[i] = round(rgb[0] * 0.2989 + rgb[1] * 0.5870 + rgb[2] * 0.1140);
+    }
+    return ret;
+}
+
+/* Weights of the input pixels covered by each output pixel when resampling
+ * `in` pixels to `out`, each output pixel averaging the area it covers. Each
+ * entry is (first input pixel, weights). */
+static inline std::vector<std::pair<size_t, std::vector<float>>> area_weights(size_t in, size_t out) {
+    std::vector<std::pair<size_t, std::vector<float>>> ret(out);
+    double scale = (double) in / out;
+    for (size_t o = 0; o < out; o++) {
+        double start = o * scale, end = (o + 1) * scale;
+        size_t first = (size_t) floor(start);
+        ret[o].first = first;
+        for (size_t i = first; i < in && i < end; i++) {
+            double overlap = std::min(end, (double) i + 1) - std::max(start, (double) i);
+            ret[o].second.push_back(overlap / scale);
+        }
+    }
+    return ret;
+}
+
+/* Weights of an area filter from the full screen to a resolution, by output
+ * row and column */
+struct area_filter_t {
+    resolution_t resolution;
+    std::vector<std::pair<size_t, std::vector<float>>> rows;
+    std::vector<std::pair<size_t, std::vector<float>>> columns;
+
+    area_filter_t(const resolution_t &resolution) :
+        resolution(resolution),
+        rows(area_weights(HEIGHT, resolution.first)),
+        columns(area_weights(WIDTH, resolution.second)) {
+    }
+};
+
+/* Converts a screen of palette indices to grayscale and resamples it to the
+ * resolution of `filter` with an area (box) filter, applied separably */
+static void area_resample(const pixel_t *screen, const std::vector<float> &luminance, const area_filter_t &filter, pixel_t *out) {
+    const resolution_t &resolution = filter.resolution;
+    const std::vector<std::pair<size_t, std::vector<float>>> &rows = filter.rows, &columns = filter.columns;
+
+    std::vector<float> horizontal(HEIGHT * resolution.second);
+    for (size_t r = 0; r < HEIGHT; r++) {
+        for (size_t c = 0; c < resolution.second; c++) {
+            const pixel_t *p = &screen[r * WIDTH + columns[c].first];
+            float sum = 0;
+            for (size_t k = 0; k < columns[c].second.size(); k++) {
+                sum += columns[c].second[k] * luminance[p[k]];
+            }
+            horizontal[r * resolution.second + c] = sum;
+        }
+    }
+
+    for (size_t r = 0; r < resolution.first; r++) {
+        for (size_t c = 0; c < resolution.second; c++) {
+            const float *p = &horizontal[rows[r].first * resolution.second + c];
+            float sum = 0;
+            for (size_t k = 0; k < rows[r].second.size(); k++) {
+                sum += rows[r].second[k] * p[k * resolution.second];
+            }
+            out[r * resolution.second + c] = (pixel_t) std::min(255.0f, std::max(0.0f, roundf(sum)));
+        }
+    }
 }
 
 static inline int path_to_number(const char *path) {
@@ -1085,80 +1177,54 @@ static inline std::vector<std::string> agcd_listdir(const char *path, bool add_p
     return ret;
 }
 
-static herr_t write_dataset(hid_t loc_id, const char *dset_name, int rank,
-        const hsize_t *dims, hid_t tid, const void *data) {
-
-    bool error = false;
-    hid_t did = -1, sid = -1;
-
-    if (dset_name == NULL) {
-        return -1;
-    }
-
-    if((sid = H5Screate_simple(rank, dims, NULL)) < 0) {
-        return -1;
-    }
-
-    hid_t plist_id = H5Pcreate(H5P_DATASET_CREATE);
-    if (!error && H5Pset_chunk(plist_id, rank, dims) < 0) {
-        error = true;
-    }
-
-    if (!error && H5Pset_deflate(plist_id, 3)) {
-        error = true;
-    }
-
-    if (!error && (did = H5Dcreate2(loc_id, dset_name, tid, sid, H5P_DEFAULT, plist_id, H5P_DEFAULT)) < 0) {
-        error = true;
-    }
-
-    if (data) {
-        if (!error && H5Dwrite(did, tid, H5S_ALL, H5S_ALL, H5P_DEFAULT, data) < 0) {
-            error = true;
-        }
-    }
-
-    if (error) {
-        H5E_BEGIN_TRY {
-            H5Dclose(did);
-            H5Sclose(sid);
-        } H5E_END_TRY;
-        return -1;
-    }
-
-    if(H5Dclose(did) < 0) {
-        return -1;
-    }
-
-    if(H5Sclose(sid) < 0) {
-        return -1;
-    }
-
-    return 0;
-}
-
-
-static inline int create_dataset(const std::string &game, const std::string &trajectory, const std::vector<std::string> &screens, std::vector<agcd_frame_t> events, hid_t screen_group, const hid_t event_group) {
+/* Loads all screens of a trajectory, frame-major. The caller frees them. */
+static pixel_t *load_screens(const std::string &game, const std::string &trajectory, const std::vector<std::string> &screens) {
     pixel_t *buffer = (pixel_t *) malloc(sizeof(pixel_t) * WIDTH * HEIGHT * screens.size());
     pixel_t *p = buffer;
-    int ret = 0;
     std::string prefix = "screens/" + game + "/" + trajectory + "/";
     for (size_t i = 0; i < screens.size(); i++, p += (WIDTH * HEIGHT)) {
         load_screen((prefix + screens[i]).c_str(), p);
     }
+    return buffer;
+}
+
+static inline int create_dataset(const std::string &game, const std::string &trajectory, const std::vector<std::string> &screens, std::vector<agcd_frame_t> events, hid_t screen_group, const hid_t event_group, const std::vector<hid_t> &resolution_groups, const converter_options_t &options) {
+    pixel_t *buffer = load_screens(game, trajectory, screens);
+    int ret = 0;
 
     const char *trajectory_str = trajectory.c_str();
-    hsize_t dims[3] = {HEIGHT, WIDTH, screens.size()};
-    herr_t status = write_dataset(screen_group, trajectory_str, 3, dims, H5T_NATIVE_UCHAR, buffer);
+    /* Frames are stored frame-major, so that any range of frames can be read
+     * with a hyperslab touching only the chunks that contain it */
+    hsize_t dims[3] = {screens.size(), HEIGHT, WIDTH};
+    hsize_t chunk[3] = {std::min(options.chunk_frames, (hsize_t) screens.size()), HEIGHT, WIDTH};
+    herr_t status = write_dataset(screen_group, trajectory_str, 3, dims, H5T_NATIVE_UCHAR, buffer, chunk,
+                                  options.contiguous);
     if (status < 0) {
         std::cerr << "Failed to write screen dataset for trajectory " << trajectory_str << std::endl;
         ret = 1;
     }
 
-    dims[1] = 5;
-    dims[0] = screens.size();
-    agcd_frame_t *frames = &events[0];
-    status = write_dataset(event_group, trajectory_str, 2, dims, H5T_NATIVE_INT, frames);
+    static const std::vector<float> luminance = palette_luminance();
+    for (size_t i = 0; i < options.resolutions.size(); i++) {
+        const resolution_t &resolution = options.resolutions[i];
+        const area_filter_t filter(resolution);
+        size_t size = resolution.first * resolution.second;
+        std::vector<pixel_t> resized(size * screens.size());
+        for (size_t j = 0; j < screens.size(); j++) {
+            area_resample(buffer + j * WIDTH * HEIGHT, luminance, filter, &resized[j * size]);
+        }
+        hsize_t resized_dims[3] = {screens.size(), resolution.first, resolution.second};
+        hsize_t resized_chunk[3] = {chunk[0], resolution.first, resolution.second};
+        status = write_dataset(resolution_groups[i], trajectory_str, 3, resized_dims, H5T_NATIVE_UCHAR, &resized[0],
+                               resized_chunk, options.contiguous);
+        if (status < 0) {
+            std::cerr << "Failed to write " << resolution_group(resolution)
+                      << " dataset for trajectory " << trajectory_str << std::endl;
+            ret = 1;
+        }
+    }
+
+    status = write_events(event_group, trajectory_str, events);
     if (status < 0) {
         std::cerr << "Failed to write event dataset for trajectory " << trajectory_str << std::endl;
         ret = 1;
@@ -1169,7 +1235,9 @@ static inline int create_dataset(const std::string &game, const std::string &tra
     return ret;
 }
 
-static inline int create_datasets(const std::string &game, const std::vector<std::string> &trajectories, const hid_t screen_group, const hid_t event_group) {
+/* Converts every trajectory of a game, appending the ones written to
+ * `written` along with their number of frames */
+static inline int create_datasets(const std::string &game, const std::vector<std::string> &trajectories, const hid_t screen_group, const hid_t event_group, const std::vector<hid_t> &resolution_groups, const converter_options_t &options, game_vector_pair_t &written) {
     int ret = 0;
     for (size_t i = 0; i < trajectories.size(); i++) {
         std::vector<std::string> screens = agcd_listdir(("screens/" + game + "/" + trajectories[i]).c_str(), false, true);
@@ -1180,18 +1248,203 @@ static inline int create_datasets(const std::string &game, const std::vector<std
             continue;
         }
 
-        ret = ret | create_dataset(game, trajectories[i], screens, events, screen_group, event_group);
+        int status = create_dataset(game, trajectories[i], screens, events, screen_group, event_group, resolution_groups, options);
+        if (status == 0) {
+            written.push_back(game_pair_t(trajectories[i], screens.size()));
+        }
+        ret = ret | status;
+    }
+    return ret;
+}
+
+/* Writes `size` bytes at the end of the file, after padding it to a multiple
+ * of `alignment`. Returns where they start. */
+static uint64_t append_aligned(FILE *fp, const void *data, size_t size, size_t alignment) {
+    uint64_t offset = ftello(fp);
+    static const char zeros[4096] = {0};
+    if (offset % alignment) {
+        size_t padding = alignment - offset % alignment;
+        fwrite(zeros, 1, padding, fp);
+        offset += padding;
+    }
+    if (size > 0 && fwrite(data, 1, size, fp) != size) {
+        perror("Failed to write pack file");
+        exit(1);
+    }
+    return offset;
+}
+
+/* Appends the events and screens of a trajectory to a pack file */
+static int append_pack_trajectory(FILE *fp, const std::string &game, const std::string &trajectory, const std::vector<std::string> &screens, const std::vector<agcd_frame_t> &events, const converter_options_t &options, agcd_pack_trajectory_t &entry) {
+    memset(&entry, 0, sizeof(entry));
+    if (trajectory.size() >= sizeof(entry.id)) {
+        fprintf(stderr, "Trajectory id %s is too long. Skipping...\n", trajectory.c_str());
+        return 1;
+    }
+    memcpy(entry.id, trajectory.data(), trajectory.size());
+    entry.frames = events.size();
+    entry.height = HEIGHT;
+    entry.width = WIDTH;
+    entry.compression = options.pack_compression;
+
+    size_t frames = events.size();
+    std::vector<uint8_t> columns(10 * frames);
+    for (size_t i = 0; i < frames; i++) {
+        int32_t reward = events[i].reward, score = events[i].score;
+        memcpy(&columns[4 * i], &reward, 4);
+        memcpy(&columns[4 * (frames + i)], &score, 4);
+        columns[8 * frames + i] = (int8_t) events[i].action;
+        columns[9 * frames + i] = events[i].terminal ? 1 : 0;
+    }
+    entry.events_offset = append_aligned(fp, &columns[0], columns.size(), 8);
+
+    pixel_t *buffer = load_screens(game, trajectory, screens);
+    const size_t frame_size = WIDTH * HEIGHT;
+    if (options.pack_compression == AGCD_PACK_RLE) {
+        std::vector<uint64_t> offsets(frames + 1);
+        std::vector<uint8_t> encoded;
+        for (size_t i = 0; i < frames; i++) {
+            offsets[i] = (frames + 1) * sizeof(uint64_t) + encoded.size();
+            agcd_pack_rle_encode(buffer + i * frame_size, frame_size, encoded);
+        }
+        offsets[frames] = (frames + 1) * sizeof(uint64_t) + encoded.size();
+        entry.screens_offset = append_aligned(fp, &offsets[0], offsets.size() * sizeof(uint64_t), 4096);
+        append_aligned(fp, encoded.empty() ? NULL : &encoded[0], encoded.size(), 1);
+        entry.screens_size = offsets[frames];
+    } else {
+        entry.screens_offset = append_aligned(fp, buffer, frames * frame_size, 4096);
+        entry.screens_size = frames * frame_size;
+    }
+    free(buffer);
+
+    return 0;
+}
+
+static int create_pack(const char *path, const std::vector<std::string> &games, const converter_options_t &options) {
+    FILE *fp = fopen(path, "wbx");
+    if (fp == NULL) {
+        perror("Unable to create pack file");
+        return 1;
+    }
+
+    agcd_pack_header_t header;
+    memset(&header, 0, sizeof(header));
+    append_aligned(fp, &header, sizeof(header), 1);
+
+    int ret = 0;
+    std::vector<agcd_pack_game_t> game_entries;
+    for (size_t i = 0; i < games.size(); i++) {
+        agcd_pack_game_t game_entry;
+        memset(&game_entry, 0, sizeof(game_entry));
+        if (games[i].size() >= sizeof(game_entry.name)) {
+            fprintf(stderr, "Game name %s is too long. Skipping...\n", games[i].c_str());
+            continue;
+        }
+        memcpy(game_entry.name, games[i].data(), games[i].size());
+
+        std::vector<agcd_pack_trajectory_t> trajectory_entries;
+        std::vector<std::string> trajectories = agcd_listdir(("screens/" + games[i]).c_str(), false, true);
+        for (size_t j = 0; j < trajectories.size(); j++) {
+            std::vector<std::string> screens = agcd_listdir(("screens/" + games[i] + "/" + trajectories[j]).c_str(), false, true);
+            std::vector<agcd_frame_t> events = read_events(("trajectories/" + games[i] + "/" + trajectories[j] + ".txt").c_str());
+
+            if (screens.size() != events.size()) {
+                fprintf(stderr, "Ignoring events %s. Screens and events have different numbers of frames.\n", trajectories[j].c_str());
+                continue;
+            }
+
+            agcd_pack_trajectory_t entry;
+            if (append_pack_trajectory(fp, games[i], trajectories[j], screens, events, options, entry) == 0) {
+                trajectory_entries.push_back(entry);
+            } else {
+                ret = 1;
+            }
+        }
+
+        game_entry.num_trajectories = trajectory_entries.size();
+        game_entry.trajectories_offset = append_aligned(
+            fp, trajectory_entries.empty() ? NULL : &trajectory_entries[0],
+            trajectory_entries.size() * sizeof(agcd_pack_trajectory_t), 8
+        );
+        game_entries.push_back(game_entry);
     }
+
+    memcpy(header.magic, AGCD_PACK_MAGIC, sizeof(header.magic));
+    header.version = AGCD_PACK_VERSION;
+    header.num_games = game_entries.size();
+    header.games_offset = append_aligned(
+        fp, game_entries.empty() ? NULL : &game_entries[0],
+        game_entries.size() * sizeof(agcd_pack_game_t), 8
+    );
+
+    // The header goes last, so that interrupted conversions are not valid
+    // pack files
+    fseeko(fp, 0, SEEK_SET);
+    if (fwrite(&header, sizeof(header), 1, fp) != 1 || fclose(fp) != 0) {
+        perror("Failed to write pack file");
+        return 1;
+    }
+
     return ret;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
+    converter_options_t options;
+    int opt;
+    unsigned int height, width;
+    bool chunked = false;
+    while ((opt = getopt(argc, argv, "c:ur:p:")) != -1) {
+        switch (opt) {
+            case 'c':
+                chunked = true;
+                options.chunk_frames = atoi(optarg);
+                if (options.chunk_frames < 1) {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'u':
+                options.contiguous = true;
+                break;
+            case 'r':
+                if (sscanf(optarg, "%ux%u", &height, &width) != 2 ||
+                        height < 1 || height > HEIGHT || width < 1 || width > WIDTH) {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                if (std::find(options.resolutions.begin(), options.resolutions.end(),
+                              resolution_t(height, width)) == options.resolutions.end()) {
+                    options.resolutions.push_back(resolution_t(height, width));
+                }
+                break;
+            case 'p':
+                options.pack = true;
+                if (strcmp(optarg, "raw") == 0) {
+                    options.pack_compression = AGCD_PACK_RAW;
+                } else if (strcmp(optarg, "rle") == 0) {
+                    options.pack_compression = AGCD_PACK_RLE;
+                } else {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            default:
+                usage(argv[0]);
+                exit(1);
+        }
+    }
+    if (argc - optind != 2) {
         usage(argv[0]);
         exit(1);
     }
+    if (chunked && options.contiguous) {
+        printf("Contiguous screens (-u) have no chunks (-c). Aborting.\n");
+        exit(1);
+    }
+    const char *root = argv[optind];
+    const char *h5file = argv[optind + 1];
 
-    if (chdir(argv[1]) != 0) {
+    if (chdir(root) != 0) {
         perror("Unable to process dataset. ");
         exit(1);
     }
@@ -1199,14 +1452,18 @@ int main(int argc, char *argv[]) {
         printf("This doesn't seem like a valid AGCD dataset. Aborting.\n");
         exit(1);
     }
-    if (path_exists(argv[2])) {
-        printf("Will not overwrite existing file %s. Aborting.\n", argv[2]);
+    if (path_exists(h5file)) {
+        printf("Will not overwrite existing file %s. Aborting.\n", h5file);
         exit(1);
     }
 
     std::vector<std::string> games = agcd_listdir("screens");
 
-    hid_t file_id = H5Fcreate(argv[2], H5F_ACC_EXCL, H5P_DEFAULT, H5P_DEFAULT);
+    if (options.pack) {
+        return create_pack(h5file, games, options) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    hid_t file_id = H5Fcreate(h5file, H5F_ACC_EXCL, H5P_DEFAULT, H5P_DEFAULT);
 
     hsize_t palette_dims[2] = {256, 3};
     write_dataset(file_id, "/palette", 2, palette_dims, H5T_NATIVE_UCHAR, NTSC_palette);
@@ -1215,12 +1472,23 @@ int main(int argc, char *argv[]) {
         hid_t group_id = H5Gcreate(file_id, ("/" + games[i]).c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
         hid_t event_id = H5Gcreate(group_id, "trajectories", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
         hid_t screen_id = H5Gcreate(group_id, "screens", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        std::vector<hid_t> resolution_ids;
+        for (size_t j = 0; j < options.resolutions.size(); j++) {
+            resolution_ids.push_back(H5Gcreate(
+                group_id, resolution_group(options.resolutions[j]).c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT
+            ));
+        }
 
-        create_datasets(games[i], agcd_listdir(("screens/" + games[i]).c_str(), false, true), screen_id, event_id);
+        game_vector_pair_t written;
+        create_datasets(games[i], agcd_listdir(("screens/" + games[i]).c_str(), false, true), screen_id, event_id, resolution_ids, options, written);
+        create_global_index(group_id, games[i], written, options.resolutions);
 
         H5Gclose(group_id);
         H5Gclose(event_id);
         H5Gclose(screen_id);
+        for (size_t j = 0; j < resolution_ids.size(); j++) {
+            H5Gclose(resolution_ids[j]);
+        }
     }
 
     H5Fclose(file_id);
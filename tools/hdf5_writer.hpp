@@ -0,0 +1,259 @@
+#ifndef ALE_ATARI_GRAND_CHALLENGE_HDF5_WRITER_HPP
+#define ALE_ATARI_GRAND_CHALLENGE_HDF5_WRITER_HPP
+
+/*
+ * Writes the datasets of an AGCD HDF5 file, as read by H5Wrapper. Shared by
+ * agcd-to-hdf5 and agcd-repack.
+ */
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#include <hdf5.h>
+
+#include "../src/trajectory_store.hpp"
+
+/* Height and width of a downscaled copy of the screens */
+typedef std::pair<hsize_t, hsize_t> resolution_t;
+
+/* Name of the group holding the screens of a game at the given resolution */
+static inline std::string resolution_group(const resolution_t &resolution) {
+    std::ostringstream ss;
+    ss << "screens_" << resolution.first << "x" << resolution.second << "_gray";
+    return ss.str();
+}
+
+/* Creates a dataset, chunked and compressed at `deflate_level` (0 for no
+ * compression) unless contiguous, and writes `data` to it if not NULL */
+static herr_t write_dataset(hid_t loc_id, const char *dset_name, int rank,
+        const hsize_t *dims, hid_t tid, const void *data, const hsize_t *chunk=NULL, bool contiguous=false,
+        int deflate_level=3) {
+    bool error = false;
+    hid_t did = -1, sid = -1;
+
+    if (dset_name == NULL) {
+        return -1;
+    }
+
+    if((sid = H5Screate_simple(rank, dims, NULL)) < 0) {
+        return -1;
+    }
+
+    hid_t plist_id = H5Pcreate(H5P_DATASET_CREATE);
+    if (contiguous) {
+        if (H5Pset_layout(plist_id, H5D_CONTIGUOUS) < 0) {
+            error = true;
+        }
+    } else {
+        if (!error && H5Pset_chunk(plist_id, rank, chunk ? chunk : dims) < 0) {
+            error = true;
+        }
+
+        if (!error && deflate_level > 0 && H5Pset_deflate(plist_id, deflate_level) < 0) {
+            error = true;
+        }
+    }
+
+    if (!error && (did = H5Dcreate2(loc_id, dset_name, tid, sid, H5P_DEFAULT, plist_id, H5P_DEFAULT)) < 0) {
+        error = true;
+    }
+    H5Pclose(plist_id);
+
+    if (data) {
+        if (!error && H5Dwrite(did, tid, H5S_ALL, H5S_ALL, H5P_DEFAULT, data) < 0) {
+            error = true;
+        }
+    }
+
+    if (error) {
+        H5E_BEGIN_TRY {
+            H5Dclose(did);
+            H5Sclose(sid);
+        } H5E_END_TRY;
+        return -1;
+    }
+
+    if(H5Dclose(did) < 0) {
+        return -1;
+    }
+
+    if(H5Sclose(sid) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Writes a column of integers using the narrowest of int16 and int32 that
+ * holds all of its values */
+static herr_t write_int_column(hid_t loc_id, const char *name, const std::vector<int> &values) {
+    hsize_t dims[1] = {values.size()};
+    bool fits_int16 = true;
+    for (size_t i = 0; i < values.size() && fits_int16; i++) {
+        fits_int16 = values[i] >= INT16_MIN && values[i] <= INT16_MAX;
+    }
+    if (fits_int16) {
+        std::vector<int16_t> narrow(values.begin(), values.end());
+        return write_dataset(loc_id, name, 1, dims, H5T_NATIVE_INT16, &narrow[0]);
+    }
+    return write_dataset(loc_id, name, 1, dims, H5T_NATIVE_INT, &values[0]);
+}
+
+/* Events are stored as a group of narrow columns, so that readers can fetch
+ * only the ones they need. Frame numbers are implied by the position in the
+ * columns, and scores are delta-coded, which usually fit in 16 bits. */
+template <typename frame_t>
+static herr_t write_events(hid_t event_group, const char *name, const std::vector<frame_t> &events) {
+    hid_t group_id = H5Gcreate(event_group, name, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    if (group_id < 0) {
+        return -1;
+    }
+
+    std::vector<int8_t> actions(events.size());
+    std::vector<uint8_t> terminals(events.size());
+    std::vector<int> rewards(events.size());
+    std::vector<int> score_deltas(events.size());
+    for (size_t i = 0; i < events.size(); i++) {
+        actions[i] = events[i].action;
+        terminals[i] = events[i].terminal;
+        rewards[i] = events[i].reward;
+        score_deltas[i] = events[i].score - (i > 0 ? events[i - 1].score : 0);
+    }
+
+    hsize_t dims[1] = {events.size()};
+    herr_t status = 0;
+    if (write_dataset(group_id, "action", 1, dims, H5T_NATIVE_INT8, &actions[0]) < 0 ||
+            write_dataset(group_id, "terminal", 1, dims, H5T_NATIVE_UINT8, &terminals[0]) < 0 ||
+            write_int_column(group_id, "reward", rewards) < 0 ||
+            write_int_column(group_id, "score_delta", score_deltas) < 0) {
+        status = -1;
+    }
+
+    H5Gclose(group_id);
+    return status;
+}
+
+
+/* Creates a virtual dataset laying the `sources` datasets end to end along
+ * their first dimension, source i starting at row offsets[i]. `dims` are the
+ * dimensions of the result. */
+static herr_t write_virtual_dataset(hid_t loc_id, const char *name, hid_t tid, int rank, const hsize_t *dims,
+        const std::vector<std::string> &sources, const std::vector<hsize_t> &offsets) {
+    hid_t space_id = H5Screate_simple(rank, dims, NULL);
+    hid_t plist_id = H5Pcreate(H5P_DATASET_CREATE);
+    herr_t status = 0;
+
+    for (size_t i = 0; i < sources.size() && status >= 0; i++) {
+        hsize_t start[3] = {offsets[i], 0, 0};
+        hsize_t count[3] = {offsets[i + 1] - offsets[i], rank > 1 ? dims[1] : 1, rank > 2 ? dims[2] : 1};
+        if (count[0] == 0) {
+            continue;
+        }
+        hid_t source_space_id = H5Screate_simple(rank, count, NULL);
+        // "." is the file the virtual dataset is in
+        if (H5Sselect_hyperslab(space_id, H5S_SELECT_SET, start, NULL, count, NULL) < 0 ||
+                H5Pset_virtual(plist_id, space_id, ".", sources[i].c_str(), source_space_id) < 0) {
+            status = -1;
+        }
+        H5Sclose(source_space_id);
+    }
+
+    if (status >= 0) {
+        H5Sselect_all(space_id);
+        hid_t dataset_id = H5Dcreate2(loc_id, name, tid, space_id, H5P_DEFAULT, plist_id, H5P_DEFAULT);
+        if (dataset_id < 0) {
+            status = -1;
+        } else {
+            H5Dclose(dataset_id);
+        }
+    }
+
+    H5Pclose(plist_id);
+    H5Sclose(space_id);
+    return status;
+}
+
+/* Builds /<game>/global, a frame index over all trajectories of a game:
+ * virtual datasets concatenating their screens (at full size and at every
+ * `downscaled` resolution) and event columns, the trajectory ids, and
+ * offsets, where offsets[i] is the global index of the first frame of
+ * trajectory i. */
+static int create_global_index(hid_t game_group, const std::string &game, const game_vector_pair_t &trajectories, const std::vector<resolution_t> &downscaled) {
+    if (trajectories.empty()) {
+        return 0;
+    }
+
+    std::vector<hsize_t> offsets(1, 0);
+    size_t id_size = 1;
+    for (size_t i = 0; i < trajectories.size(); i++) {
+        offsets.push_back(offsets.back() + trajectories[i].second);
+        id_size = std::max(id_size, trajectories[i].first.size() + 1);
+    }
+    const hsize_t frames = offsets.back();
+
+    hid_t group_id = H5Gcreate(game_group, "global", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    if (group_id < 0) {
+        return 1;
+    }
+
+    int ret = 0;
+    std::vector<char> ids(id_size * trajectories.size(), 0);
+    for (size_t i = 0; i < trajectories.size(); i++) {
+        memcpy(&ids[i * id_size], trajectories[i].first.c_str(), trajectories[i].first.size());
+    }
+    hid_t id_type = H5Tcopy(H5T_C_S1);
+    H5Tset_size(id_type, id_size);
+    hsize_t ids_dims[1] = {trajectories.size()};
+    hsize_t offsets_dims[1] = {offsets.size()};
+    if (write_dataset(group_id, "ids", 1, ids_dims, id_type, &ids[0]) < 0 ||
+            write_dataset(group_id, "offsets", 1, offsets_dims, H5T_NATIVE_UINT64, &offsets[0]) < 0) {
+        ret = 1;
+    }
+    H5Tclose(id_type);
+
+    std::vector<std::string> screen_groups(1, "screens");
+    std::vector<resolution_t> resolutions(1, resolution_t(HEIGHT, WIDTH));
+    for (size_t i = 0; i < downscaled.size(); i++) {
+        screen_groups.push_back(resolution_group(downscaled[i]));
+        resolutions.push_back(downscaled[i]);
+    }
+    for (size_t i = 0; i < screen_groups.size(); i++) {
+        std::vector<std::string> sources;
+        for (size_t j = 0; j < trajectories.size(); j++) {
+            sources.push_back("/" + game + "/" + screen_groups[i] + "/" + trajectories[j].first);
+        }
+        hsize_t dims[3] = {frames, resolutions[i].first, resolutions[i].second};
+        if (write_virtual_dataset(group_id, screen_groups[i].c_str(), H5T_NATIVE_UCHAR, 3, dims, sources, offsets) < 0) {
+            ret = 1;
+        }
+    }
+
+    // Narrow columns are converted to the type of the virtual dataset on read
+    static const char *columns[] = {"action", "terminal", "reward", "score_delta"};
+    const hid_t column_types[] = {H5T_NATIVE_INT8, H5T_NATIVE_UINT8, H5T_NATIVE_INT, H5T_NATIVE_INT};
+    for (size_t i = 0; i < 4; i++) {
+        std::vector<std::string> sources;
+        for (size_t j = 0; j < trajectories.size(); j++) {
+            sources.push_back("/" + game + "/trajectories/" + trajectories[j].first + "/" + columns[i]);
+        }
+        hsize_t dims[1] = {frames};
+        if (write_virtual_dataset(group_id, columns[i], column_types[i], 1, dims, sources, offsets) < 0) {
+            ret = 1;
+        }
+    }
+
+    H5Gclose(group_id);
+    if (ret) {
+        std::cerr << "Failed to write the global index of " << game << std::endl;
+    }
+    return ret;
+}
+
+
+#endif //ALE_ATARI_GRAND_CHALLENGE_HDF5_WRITER_HPP